@@ -22,10 +22,20 @@ BuildRequires:  pkgconfig(android-headers)
 BuildRequires:  pkgconfig(libgbinder) >= 1.0.32
 BuildRequires:  pkgconfig(glib-2.0)
 BuildRequires:  pkgconfig(gio-2.0)
+BuildRequires:  systemtap-sdt-devel
 
 %description
 PulseAudio Droid HIDL module.
 
+%package devel
+Summary:    Development files for PulseAudio Droid HIDL module
+Requires:   %{name} = %{version}-%{release}
+Requires:   pkgconfig(pulsecore) >= %{pulsemajorminor}
+
+%description devel
+Header for PulseAudio modules using the in-process API of the
+PulseAudio Droid HIDL module.
+
 
 %prep
 %setup -q -n %{name}-%{version}
@@ -43,3 +53,7 @@ rm -rf %{buildroot}
 %defattr(-,root,root,-)
 %{_libdir}/pulse-%{pulsemajorminor}/modules/module-droid-hidl.so
 %{_libexecdir}/pulse/hidl-helper
+
+%files devel
+%defattr(-,root,root,-)
+%{_includedir}/pulsecore/modules/droid-hidl/droid-hidl.h
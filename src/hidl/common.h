@@ -26,11 +26,40 @@
 
 #define HELPER_NAME                             "hidl-helper"
 
+/* The helper prints a heartbeat line with its state to the module pipe
+ * every HELPER_HEARTBEAT_INTERVAL_MS from its main loop. Kept long, as it
+ * wakes up both the helper and PulseAudio on an idle device. */
+#define HELPER_HEARTBEAT                        "@heartbeat"
+#define HELPER_HEARTBEAT_INTERVAL_MS            (10000)
+/* Heartbeat field with helper wakeups and main thread CPU time per
+ * event source, as source:count:usec[,source:count:usec...] */
+#define HELPER_HEARTBEAT_WAKEUPS                "wakeups="
+
+/* Exit status of the helper when oFono configuration has no binder slots
+ * left. The module doesn't restart it until slots are configured. */
+#define HELPER_EXIT_NO_SLOTS                    (3)
+
+#define OFONO_RIL_SUBSCRIPTION_CONF             "/etc/ofono/ril_subscription.conf"
+#define OFONO_RIL_SUBSCRIPTION_D                "/etc/ofono/ril_subscription.d"
+
 #define HIDL_PASSTHROUGH_PATH                   "/org/sailfishos/hidlpassthrough"
 #define HIDL_PASSTHROUGH_IFACE                  "org.SailfishOS.HIDLPassthrough"
 
 #define HIDL_PASSTHROUGH_METHOD_GET_PARAMETERS  "get_parameters"
 #define HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS  "set_parameters"
+#define HIDL_PASSTHROUGH_METHOD_GET_STATISTICS  "get_statistics"
+#define HIDL_PASSTHROUGH_METHOD_DUMP_FLIGHT_RECORDER "dump_flight_recorder"
+#define HIDL_PASSTHROUGH_METHOD_GET_PARAMETERS_TRACED "get_parameters_traced"
+#define HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS_TRACED "set_parameters_traced"
+#define HIDL_PASSTHROUGH_METHOD_REPORT_TRACE    "report_trace"
+#define HIDL_PASSTHROUGH_METHOD_GET_TRACES      "get_traces"
+#define HIDL_PASSTHROUGH_METHOD_GET_TRACE_SIZE  "get_trace_size"
+#define HIDL_PASSTHROUGH_METHOD_GET_SLOW_HAL_CALLS "get_slow_hal_calls"
+#define HIDL_PASSTHROUGH_METHOD_GET_OPTIMISTIC_KEYS "get_optimistic_keys"
+#define HIDL_PASSTHROUGH_METHOD_GET_PRIORITY_STATS "get_priority_stats"
+#define HIDL_PASSTHROUGH_METHOD_GET_CLIENT_STATS "get_client_stats"
+#define HIDL_PASSTHROUGH_METHOD_QUERY_PARAMETERS "query_parameters"
+#define HIDL_PASSTHROUGH_METHOD_GET_HELPER_WAKEUPS "get_helper_wakeups"
 
 #define PULSE_ENV_LOG_LEVEL                     "PULSE_LOG"
 #define PULSE_LOG_LEVEL_DEBUG                   (4)
@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foodroidhidlfoo
+#define foodroidhidlfoo
+
+#include <pulsecore/core.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/hook-list.h>
+#include <pulsecore/shared.h>
+
+/* In-process API of module-droid-hidl for other PulseAudio modules.
+ *
+ * module-droid-hidl registers the API in pa_shared while it is loaded.
+ * Calls go through the same state, statistics and flight recorder as
+ * D-Bus requests, without D-Bus marshalling. All functions must be called
+ * from the main thread.
+ *
+ *     pa_droid_hidl_api *api;
+ *     char *value;
+ *
+ *     if ((api = pa_droid_hidl_api_get(core))) {
+ *         value = api->get_parameters(api, "call_state");
+ *         ...
+ *         pa_xfree(value);
+ *     }
+ *
+ * A module keeping api or hook slots around connects to the unloading
+ * hook and drops them all there:
+ *
+ *     static pa_hook_result_t unloading_cb(pa_droid_hidl_api *api, void *call_data, struct userdata *u) {
+ *         pa_hook_slot_free(u->changed_slot);
+ *         pa_hook_slot_free(u->unloading_slot);
+ *         u->changed_slot = u->unloading_slot = NULL;
+ *         u->api = NULL;
+ *         return PA_HOOK_OK;
+ *     }
+ */
+
+#define PA_DROID_HIDL_API_NAME      "droid-hidl-api"
+#define PA_DROID_HIDL_API_VERSION   (1)
+
+typedef struct pa_droid_hidl_api pa_droid_hidl_api;
+typedef struct pa_droid_hidl_subscription pa_droid_hidl_subscription;
+
+/* Called after key_value_pairs were applied to the HAL, whoever set them.
+ * key_value_pairs is NULL when module-droid-hidl is unloaded, after which
+ * api must not be used and the subscription is gone. */
+typedef void (*pa_droid_hidl_changed_cb_t)(pa_droid_hidl_api *api, const char *key_value_pairs, void *userdata);
+
+typedef enum pa_droid_hidl_origin {
+    /* D-Bus client other than the helper */
+    PA_DROID_HIDL_ORIGIN_DBUS,
+    /* Modem, through the helper */
+    PA_DROID_HIDL_ORIGIN_HELPER,
+    /* In-process API */
+    PA_DROID_HIDL_ORIGIN_MODULE,
+    /* Writes held back while suspended, applied on resume */
+    PA_DROID_HIDL_ORIGIN_DEFERRED
+} pa_droid_hidl_origin_t;
+
+/* Call data of the changed hook. */
+typedef struct pa_droid_hidl_changed_data {
+    /* const char *key -> const char *value, as written to the HAL */
+    pa_hashmap *parameters;
+    pa_droid_hidl_origin_t origin;
+    /* Modem slot of helper requests, otherwise NULL. */
+    const char *slot;
+    /* 0 on success, otherwise the HAL error. */
+    int result;
+} pa_droid_hidl_changed_data;
+
+struct pa_droid_hidl_api {
+    unsigned version;
+
+    /* Returns newly allocated key-value pairs, free with pa_xfree(). NULL
+     * if hw module is not available. */
+    char *(*get_parameters)(pa_droid_hidl_api *api, const char *keys);
+    /* Returns 0 on success, negative if hw module is not available,
+     * otherwise the HAL error. */
+    int (*set_parameters)(pa_droid_hidl_api *api, const char *key_value_pairs);
+
+    pa_droid_hidl_subscription *(*subscribe)(pa_droid_hidl_api *api, pa_droid_hidl_changed_cb_t cb, void *userdata);
+    void (*unsubscribe)(pa_droid_hidl_api *api, pa_droid_hidl_subscription *subscription);
+
+    /* Fired with pa_droid_hidl_changed_data after every setParameters that
+     * reached the HAL, in the same main loop iteration. Slots must be freed
+     * from the unloading hook at the latest. */
+    pa_hook changed;
+
+    /* Fired with NULL call data when module-droid-hidl starts unloading,
+     * before anything is torn down. Every slot of the changed and unloading
+     * hooks must be freed by the time this hook returns, freeing them from
+     * the callback itself is fine. Any slots left are freed by
+     * module-droid-hidl, and freeing them later is a use after free. api
+     * must not be used after this. */
+    pa_hook unloading;
+};
+
+/* Returns NULL if module-droid-hidl is not loaded or is too old. */
+static inline pa_droid_hidl_api *pa_droid_hidl_api_get(pa_core *core) {
+    pa_droid_hidl_api *api;
+
+    if ((api = pa_shared_get(core, PA_DROID_HIDL_API_NAME)) && api->version >= PA_DROID_HIDL_API_VERSION)
+        return api;
+
+    return NULL;
+}
+
+#endif
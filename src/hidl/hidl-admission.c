@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/llist.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "hidl-admission.h"
+
+struct hidl_admission {
+    /* Credit used by one request and maximum credit of a client, in usec
+     * of refill time. */
+    pa_usec_t cost;
+    pa_usec_t max_credit;
+    unsigned max_queued;
+
+    PA_LLIST_HEAD(hidl_admission_client, clients);
+};
+
+hidl_admission *hidl_admission_new(unsigned rate, unsigned burst, unsigned max_queued) {
+    hidl_admission *a;
+
+    a = pa_xnew0(hidl_admission, 1);
+    a->max_queued = max_queued;
+
+    if (rate > 0) {
+        a->cost = PA_USEC_PER_SEC / rate;
+        a->max_credit = a->cost * PA_MAX(burst, 1U);
+    }
+
+    PA_LLIST_HEAD_INIT(hidl_admission_client, a->clients);
+
+    return a;
+}
+
+void hidl_admission_free(hidl_admission *a) {
+    pa_assert(a);
+    pa_assert(!a->clients);
+
+    pa_xfree(a);
+}
+
+hidl_admission_client *hidl_admission_client_new(hidl_admission *a, const char *name, bool exempt, void *owner) {
+    hidl_admission_client *c;
+
+    pa_assert(a);
+    pa_assert(name);
+
+    c = pa_xnew0(hidl_admission_client, 1);
+    c->admission = a;
+    c->name = pa_xstrdup(name);
+    c->exempt = exempt;
+    c->owner = owner;
+    c->credit = a->max_credit;
+    c->refilled = pa_rtclock_now();
+
+    PA_LLIST_PREPEND(hidl_admission_client, a->clients, c);
+
+    return c;
+}
+
+void hidl_admission_client_free(hidl_admission_client *c) {
+    pa_assert(c);
+
+    PA_LLIST_REMOVE(hidl_admission_client, c->admission->clients, c);
+    pa_xfree(c->name);
+    pa_xfree(c);
+}
+
+static void refill(hidl_admission_client *c) {
+    pa_usec_t now;
+
+    now = pa_rtclock_now();
+    c->credit = PA_MIN(c->credit + (now - c->refilled), c->admission->max_credit);
+    c->refilled = now;
+}
+
+enum hidl_admission_result hidl_admission_check(hidl_admission_client *c, unsigned queued) {
+    hidl_admission *a;
+    enum hidl_admission_result result = HIDL_ADMISSION_ACCEPT;
+
+    pa_assert(c);
+
+    a = c->admission;
+
+    if (!c->exempt) {
+        if (a->max_queued > 0 && queued >= a->max_queued)
+            result = HIDL_ADMISSION_QUEUE_FULL;
+        else if (a->cost > 0) {
+            refill(c);
+            if (c->credit < a->cost)
+                result = HIDL_ADMISSION_RATE_LIMITED;
+            else
+                c->credit -= a->cost;
+        }
+    }
+
+    switch (result) {
+        case HIDL_ADMISSION_ACCEPT:
+            c->accepted++;
+            if (c->throttled) {
+                pa_log_info("Client %s no longer throttled.", c->name);
+                c->throttled = false;
+            }
+            break;
+
+        case HIDL_ADMISSION_RATE_LIMITED:
+            c->rate_limited++;
+            break;
+
+        case HIDL_ADMISSION_QUEUE_FULL:
+            c->queue_full++;
+            break;
+    }
+
+    if (result != HIDL_ADMISSION_ACCEPT && !c->throttled) {
+        pa_log_info("Throttling client %s, %s.", c->name,
+                    result == HIDL_ADMISSION_QUEUE_FULL ? "too many queued requests" : "request rate limit exceeded");
+        c->throttled = true;
+    }
+
+    return result;
+}
+
+hidl_admission_client *hidl_admission_iterate(hidl_admission *a, void **state) {
+    hidl_admission_client *c;
+
+    pa_assert(a);
+    pa_assert(state);
+
+    c = *state ? ((hidl_admission_client *) *state)->next : a->clients;
+    *state = c;
+
+    return c;
+}
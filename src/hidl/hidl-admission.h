@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidladmissionfoo
+#define foohidladmissionfoo
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pulse/sample.h>
+
+/* Admission control of D-Bus clients.
+ *
+ * Every client has a token bucket refilled at rate requests per second
+ * and holding at most burst requests, and all clients share a limit on
+ * the number of requests queued in the module. A request that exceeds
+ * either is rejected. Exempt clients are only counted. Zero rate or queue
+ * limit disables that limit. */
+
+typedef struct hidl_admission hidl_admission;
+
+typedef struct hidl_admission_client {
+    char *name;
+    bool exempt;
+    /* Owner of the client, for example a connection. */
+    void *owner;
+
+    uint64_t accepted;
+    uint64_t rate_limited;
+    uint64_t queue_full;
+
+    /* private */
+    hidl_admission *admission;
+    pa_usec_t credit;
+    pa_usec_t refilled;
+    bool throttled;
+    struct hidl_admission_client *prev, *next;
+} hidl_admission_client;
+
+enum hidl_admission_result {
+    HIDL_ADMISSION_ACCEPT,
+    HIDL_ADMISSION_RATE_LIMITED,
+    HIDL_ADMISSION_QUEUE_FULL
+};
+
+hidl_admission *hidl_admission_new(unsigned rate, unsigned burst, unsigned max_queued);
+/* All clients must be freed first. */
+void hidl_admission_free(hidl_admission *a);
+
+hidl_admission_client *hidl_admission_client_new(hidl_admission *a, const char *name, bool exempt, void *owner);
+void hidl_admission_client_free(hidl_admission_client *c);
+
+/* queued is the number of requests currently queued. */
+enum hidl_admission_result hidl_admission_check(hidl_admission_client *c, unsigned queued);
+
+/* Iterate clients, state must be NULL on first call. */
+hidl_admission_client *hidl_admission_iterate(hidl_admission *a, void **state);
+
+#endif
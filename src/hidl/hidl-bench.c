@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/modargs.h>
+
+#include "hidl-passthrough.h"
+#include "mock-audio-hw.h"
+
+/* Microbenchmark of the passthrough request handling, driving the same
+ * code as the D-Bus handlers of module-droid-hidl against a fake HAL. */
+
+#define DEFAULT_ITERATIONS  (100000)
+#define BENCH_MODULE_ID     "primary"
+#define BENCH_KEY           "bench_key"
+
+typedef struct bench {
+    pa_mainloop *mainloop;
+    pa_core *core;
+    mock_audio_hw *hw;
+    hidl_passthrough *passthrough;
+    unsigned iterations;
+    uint64_t *samples;
+} bench;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * PA_NSEC_PER_SEC + (uint64_t) ts.tv_nsec;
+}
+
+static int sample_cmp(const void *a, const void *b) {
+    uint64_t sa = *(const uint64_t *) a;
+    uint64_t sb = *(const uint64_t *) b;
+
+    return sa < sb ? -1 : sa > sb;
+}
+
+static void report(bench *b, const char *name, uint64_t total_ns, unsigned hal_calls) {
+    qsort(b->samples, b->iterations, sizeof(uint64_t), sample_cmp);
+
+    printf("%-24s %10u %12.0f %10.2f %10.2f %10u\n",
+           name,
+           b->iterations,
+           (double) b->iterations * PA_NSEC_PER_SEC / (double) total_ns,
+           (double) b->samples[b->iterations / 2] / PA_NSEC_PER_USEC,
+           (double) b->samples[(uint64_t) b->iterations * 99 / 100] / PA_NSEC_PER_USEC,
+           hal_calls);
+}
+
+static void run_get(bench *b, const char *name, const char *keys) {
+    unsigned calls, i;
+    uint64_t start, t;
+
+    calls = mock_audio_hw_calls(b->hw, MOCK_AUDIO_HW_GET);
+    start = now_ns();
+
+    for (i = 0; i < b->iterations; i++) {
+        t = now_ns();
+        pa_xfree(hidl_passthrough_get(b->passthrough, NULL, keys));
+        b->samples[i] = now_ns() - t;
+    }
+
+    report(b, name, now_ns() - start, mock_audio_hw_calls(b->hw, MOCK_AUDIO_HW_GET) - calls);
+}
+
+static void run_set(bench *b, const char *name, bool redundant) {
+    char pairs[64];
+    unsigned calls, i;
+    uint64_t start, t;
+
+    calls = mock_audio_hw_calls(b->hw, MOCK_AUDIO_HW_SET);
+    start = now_ns();
+
+    for (i = 0; i < b->iterations; i++) {
+        pa_snprintf(pairs, sizeof(pairs), BENCH_KEY "_0=%u", redundant ? 0 : i);
+        t = now_ns();
+        pa_assert_se(hidl_passthrough_set(b->passthrough, NULL, pairs) == 0);
+        b->samples[i] = now_ns() - t;
+    }
+
+    report(b, name, now_ns() - start, mock_audio_hw_calls(b->hw, MOCK_AUDIO_HW_SET) - calls);
+}
+
+static void usage(const char *name) {
+    printf("Usage: %s [options]\n"
+           "  -n <iterations>     iterations per benchmark, default %u\n"
+           "  -g <usec>           simulated HAL get_parameters() latency\n"
+           "  -s <usec>           simulated HAL set_parameters() latency\n"
+           "  -a <arguments>      module arguments for the passthrough\n",
+           name, DEFAULT_ITERATIONS);
+}
+
+int main(int argc, char *argv[]) {
+    bench b;
+    pa_modargs *ma;
+    const char *args = "negative_cache=true";
+    pa_usec_t get_latency = 0;
+    pa_usec_t set_latency = 0;
+    char key[32];
+    int c;
+    int i;
+
+    pa_zero(b);
+    b.iterations = DEFAULT_ITERATIONS;
+
+    while ((c = getopt(argc, argv, "n:g:s:a:h")) != -1) {
+        switch (c) {
+            case 'n':
+                b.iterations = (unsigned) atoi(optarg);
+                break;
+            case 'g':
+                get_latency = (pa_usec_t) atoll(optarg);
+                break;
+            case 's':
+                set_latency = (pa_usec_t) atoll(optarg);
+                break;
+            case 'a':
+                args = optarg;
+                break;
+            default:
+                usage(argv[0]);
+                return c == 'h' ? 0 : 1;
+        }
+    }
+
+    if (b.iterations == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    pa_log_set_level(PA_LOG_WARN);
+
+    b.mainloop = pa_mainloop_new();
+    b.core = pa_core_new(pa_mainloop_get_api(b.mainloop), false, false, 0);
+    b.hw = mock_audio_hw_new(BENCH_MODULE_ID);
+    mock_audio_hw_set_latency(b.hw, get_latency, set_latency);
+
+    for (i = 0; i < 4; i++) {
+        pa_snprintf(key, sizeof(key), BENCH_KEY "_%d", i);
+        mock_audio_hw_set_value(b.hw, key, "0");
+    }
+
+    pa_assert_se(ma = pa_modargs_new(args, NULL));
+    if (!(b.passthrough = hidl_passthrough_new(b.core, ma))) {
+        fprintf(stderr, "Invalid arguments: %s\n", args);
+        return 1;
+    }
+    pa_modargs_free(ma);
+    pa_assert_se(hidl_passthrough_attach(b.passthrough));
+
+    b.samples = pa_xnew(uint64_t, b.iterations);
+
+    printf("arguments: \"%s\", HAL latency get %llu us set %llu us\n\n",
+           args, (unsigned long long) get_latency, (unsigned long long) set_latency);
+    printf("%-24s %10s %12s %10s %10s %10s\n", "benchmark", "calls", "calls/s", "p50 us", "p99 us", "HAL calls");
+
+    run_get(&b, "get", BENCH_KEY "_0");
+    run_get(&b, "get 4 keys", BENCH_KEY "_0;" BENCH_KEY "_1;" BENCH_KEY "_2;" BENCH_KEY "_3");
+    run_get(&b, "get unsupported", "unsupported_key");
+    run_set(&b, "set", false);
+    run_set(&b, "set redundant", true);
+
+    pa_xfree(b.samples);
+    hidl_passthrough_free(b.passthrough);
+    mock_audio_hw_free(b.hw);
+    pa_core_unref(b.core);
+    pa_mainloop_free(b.mainloop);
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "hidl-capture.h"
+
+#define PAYLOAD_MAX     (UINT16_MAX)
+#define SLOT_MAX        (UINT8_MAX)
+
+struct hidl_capture {
+    char *path;
+    FILE *f;
+    pa_usec_t start;
+    bool failed;
+    bool truncated;
+};
+
+hidl_capture *hidl_capture_open(const char *path) {
+    struct hidl_capture_header header;
+    struct timeval tv;
+    hidl_capture *c;
+    FILE *f;
+
+    pa_assert(path);
+
+    if (!(f = pa_fopen_cloexec(path, "w"))) {
+        pa_log("Failed to open capture file %s: %s", path, pa_cstrerror(errno));
+        return NULL;
+    }
+
+    pa_zero(header);
+    header.magic = HIDL_CAPTURE_MAGIC;
+    header.version = HIDL_CAPTURE_VERSION;
+    header.start_usec = pa_timeval_load(pa_gettimeofday(&tv));
+
+    if (fwrite(&header, sizeof(header), 1, f) != 1 || fflush(f) != 0) {
+        pa_log("Failed to write capture file %s: %s", path, pa_cstrerror(errno));
+        fclose(f);
+        return NULL;
+    }
+
+    c = pa_xnew0(hidl_capture, 1);
+    c->path = pa_xstrdup(path);
+    c->f = f;
+    c->start = pa_rtclock_now();
+
+    pa_log_info("Capturing passthrough traffic to %s", path);
+
+    return c;
+}
+
+void hidl_capture_free(hidl_capture *c) {
+    pa_assert(c);
+
+    fclose(c->f);
+    pa_xfree(c->path);
+    pa_xfree(c);
+}
+
+uint64_t hidl_capture_now(hidl_capture *c) {
+    pa_assert(c);
+
+    return pa_rtclock_now() - c->start;
+}
+
+void hidl_capture_write(hidl_capture *c, enum hidl_capture_type type, uint64_t time_usec,
+                        const char *slot, const char *payload, uint64_t hal_usec, int result) {
+    struct hidl_capture_record record;
+    size_t slot_len, payload_len;
+
+    pa_assert(c);
+    pa_assert(payload);
+
+    if (c->failed)
+        return;
+
+    slot_len = slot ? strlen(slot) : 0;
+    payload_len = strlen(payload);
+
+    if (slot_len > SLOT_MAX)
+        slot_len = SLOT_MAX;
+
+    if (payload_len > PAYLOAD_MAX) {
+        if (!c->truncated)
+            pa_log_warn("Payload of %zu bytes truncated in capture.", payload_len);
+        c->truncated = true;
+        payload_len = PAYLOAD_MAX;
+    }
+
+    pa_zero(record);
+    record.time_usec = time_usec;
+    record.hal_usec = hal_usec > UINT32_MAX ? UINT32_MAX : (uint32_t) hal_usec;
+    record.result = result;
+    record.type = type;
+    record.slot_len = slot_len;
+    record.payload_len = payload_len;
+
+    if (fwrite(&record, sizeof(record), 1, c->f) != 1 ||
+        (slot_len && fwrite(slot, slot_len, 1, c->f) != 1) ||
+        (payload_len && fwrite(payload, payload_len, 1, c->f) != 1) ||
+        fflush(c->f) != 0) {
+        pa_log("Failed to write capture file %s: %s, capture stopped.", c->path, pa_cstrerror(errno));
+        c->failed = true;
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlcapturefoo
+#define foohidlcapturefoo
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Capture of passthrough traffic for replaying it later with hidl-replay.
+ *
+ * The file starts with struct hidl_capture_header, followed by records
+ * in host byte order. Each record is struct hidl_capture_record followed
+ * by slot_len bytes of slot name and payload_len bytes of payload, the
+ * keys or key-value pairs of the request, neither NUL terminated. This
+ * header has no PulseAudio dependencies so that tools can read captures. */
+
+#define HIDL_CAPTURE_MAGIC      (0x50414348U) /* "HCAP" */
+#define HIDL_CAPTURE_VERSION    (1)
+
+enum hidl_capture_type {
+    HIDL_CAPTURE_GET_PARAMETERS,
+    HIDL_CAPTURE_SET_PARAMETERS
+};
+
+struct hidl_capture_header {
+    uint32_t magic;
+    uint32_t version;
+    /* Wall clock time of capture start in usec, for reference only. */
+    uint64_t start_usec;
+} __attribute__((packed));
+
+struct hidl_capture_record {
+    /* Arrival of the request, usec since capture start. */
+    uint64_t time_usec;
+    /* Time spent in HAL calls while handling the request. */
+    uint32_t hal_usec;
+    /* 0 or the HAL error for set_parameters, 0 for get_parameters. */
+    int32_t result;
+    uint8_t type;
+    uint8_t slot_len;
+    uint16_t payload_len;
+} __attribute__((packed));
+
+typedef struct hidl_capture hidl_capture;
+
+hidl_capture *hidl_capture_open(const char *path);
+void hidl_capture_free(hidl_capture *c);
+
+/* Current time in the time base of records. */
+uint64_t hidl_capture_now(hidl_capture *c);
+
+/* Append a record. slot may be NULL, payload longer than fits the record
+ * is truncated. Records are flushed immediately so that a capture stays
+ * usable if the daemon is killed. */
+void hidl_capture_write(hidl_capture *c, enum hidl_capture_type type, uint64_t time_usec,
+                        const char *slot, const char *payload, uint64_t hal_usec, int result);
+
+#endif
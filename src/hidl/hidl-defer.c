@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/strbuf.h>
+
+#include "hidl-defer.h"
+
+struct hidl_defer {
+    char *defer_keys;
+    char *urgent_keys;
+    /* key -> value, in write order */
+    pa_hashmap *buffer;
+};
+
+hidl_defer *hidl_defer_new(const char *defer_keys, const char *urgent_keys) {
+    hidl_defer *d;
+
+    pa_assert(defer_keys);
+
+    d = pa_xnew0(hidl_defer, 1);
+    d->defer_keys = pa_xstrdup(defer_keys);
+    d->urgent_keys = pa_xstrdup(urgent_keys);
+    d->buffer = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                    pa_xfree, pa_xfree);
+
+    return d;
+}
+
+void hidl_defer_free(hidl_defer *d) {
+    pa_assert(d);
+
+    pa_hashmap_free(d->buffer);
+    pa_xfree(d->defer_keys);
+    pa_xfree(d->urgent_keys);
+    pa_xfree(d);
+}
+
+static bool match(const char *patterns, const char *key) {
+    const char *state = NULL;
+    char *pattern;
+    bool matched = false;
+
+    if (!patterns)
+        return false;
+
+    while (!matched && (pattern = pa_split(patterns, ",", &state))) {
+        matched = fnmatch(pattern, key, 0) == 0;
+        pa_xfree(pattern);
+    }
+
+    return matched;
+}
+
+char *hidl_defer_filter(hidl_defer *d, const char *key_value_pairs) {
+    pa_strbuf *now;
+    const char *state = NULL;
+    char *pair;
+    char *value;
+
+    pa_assert(d);
+    pa_assert(key_value_pairs);
+
+    now = pa_strbuf_new();
+
+    while ((pair = pa_split(key_value_pairs, ";", &state))) {
+        if ((value = strchr(pair, '='))) {
+            *value = '\0';
+
+            if (match(d->defer_keys, pair) && !match(d->urgent_keys, pair)) {
+                /* Re-insert so that the buffer stays in write order. */
+                pa_hashmap_remove_and_free(d->buffer, pair);
+                pa_hashmap_put(d->buffer, pair, pa_xstrdup(value + 1));
+                continue;
+            }
+
+            *value = '=';
+        }
+
+        if (!pa_strbuf_isempty(now))
+            pa_strbuf_putc(now, ';');
+        pa_strbuf_puts(now, pair);
+        pa_xfree(pair);
+    }
+
+    if (pa_strbuf_isempty(now)) {
+        pa_strbuf_free(now);
+        return NULL;
+    }
+
+    return pa_strbuf_to_string_free(now);
+}
+
+char *hidl_defer_take(hidl_defer *d) {
+    pa_strbuf *batch;
+    const void *key;
+    const char *value;
+    void *state;
+
+    pa_assert(d);
+
+    if (pa_hashmap_isempty(d->buffer))
+        return NULL;
+
+    batch = pa_strbuf_new();
+
+    state = NULL;
+    while ((value = pa_hashmap_iterate(d->buffer, &state, &key)))
+        pa_strbuf_printf(batch, "%s%s=%s", pa_strbuf_isempty(batch) ? "" : ";", (const char *) key, value);
+
+    pa_hashmap_remove_all(d->buffer);
+
+    return pa_strbuf_to_string_free(batch);
+}
+
+char *hidl_defer_override(hidl_defer *d, const char *keys, char *reply) {
+    pa_strbuf *merged;
+    const char *state = NULL;
+    const char *value;
+    char *pair;
+    char *eq;
+    char *key;
+
+    pa_assert(d);
+    pa_assert(keys);
+    pa_assert(reply);
+
+    if (pa_hashmap_isempty(d->buffer))
+        return reply;
+
+    merged = pa_strbuf_new();
+
+    /* Values the HAL returned, unless buffered. */
+    while ((pair = pa_split(reply, ";", &state))) {
+        if ((eq = strchr(pair, '=')))
+            *eq = '\0';
+
+        if (!pa_hashmap_get(d->buffer, pair)) {
+            if (eq)
+                *eq = '=';
+            pa_strbuf_printf(merged, "%s%s", pa_strbuf_isempty(merged) ? "" : ";", pair);
+        }
+
+        pa_xfree(pair);
+    }
+
+    /* Buffered values of requested keys. */
+    state = NULL;
+    while ((key = pa_split(keys, ";", &state))) {
+        if ((value = pa_hashmap_get(d->buffer, key)))
+            pa_strbuf_printf(merged, "%s%s=%s", pa_strbuf_isempty(merged) ? "" : ";", key, value);
+
+        pa_xfree(key);
+    }
+
+    pa_xfree(reply);
+
+    return pa_strbuf_to_string_free(merged);
+}
+
+unsigned hidl_defer_size(hidl_defer *d) {
+    pa_assert(d);
+
+    return pa_hashmap_size(d->buffer);
+}
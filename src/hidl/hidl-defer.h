@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidldeferfoo
+#define foohidldeferfoo
+
+#include <stdbool.h>
+
+/* Buffer of deferred parameter writes.
+ *
+ * Keys matching the deferrable patterns and none of the urgent patterns
+ * are held back, only the latest value of each key is kept. Patterns are
+ * comma separated key glob patterns. */
+
+typedef struct hidl_defer hidl_defer;
+
+hidl_defer *hidl_defer_new(const char *defer_keys, const char *urgent_keys);
+void hidl_defer_free(hidl_defer *d);
+
+/* Buffer deferrable pairs of key_value_pairs. Returns newly allocated
+ * pairs to apply now, NULL if all were buffered. */
+char *hidl_defer_filter(hidl_defer *d, const char *key_value_pairs);
+
+/* Returns newly allocated buffered pairs in write order and empties the
+ * buffer, NULL if empty. */
+char *hidl_defer_take(hidl_defer *d);
+
+/* Replace values of requested keys that are buffered in reply to a get of
+ * keys. Takes ownership of reply, returns newly allocated reply. */
+char *hidl_defer_override(hidl_defer *d, const char *keys, char *reply);
+
+unsigned hidl_defer_size(hidl_defer *d);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlflightfoo
+#define foohidlflightfoo
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+/* Flight recorder of the most recent transactions, shared by the module
+ * and the helper and thus free of PulseAudio and GLib dependencies.
+ *
+ * Entries live in a fixed power of two sized ring. A writer claims the
+ * next entry with a single atomic increment and fills it in, so the cost
+ * per transaction is constant and old entries are simply overwritten.
+ * The seq of an entry works as a seqlock: writers zero it before and set
+ * it after filling the entry in, and readers copy the entry and keep the
+ * copy only if seq was the same before and after.
+ * Stage times are CLOCK_MONOTONIC usec, which is the time base of both
+ * pa_rtclock_now() and g_get_monotonic_time(), 0 for stages not reached.
+ * What the stages mean is up to the user of the ring. */
+
+#define HIDL_FLIGHT_STAGES      (4)
+#define HIDL_FLIGHT_SLOT_MAX    (16)
+
+enum hidl_flight_type {
+    HIDL_FLIGHT_GET_PARAMETERS,
+    HIDL_FLIGHT_SET_PARAMETERS
+};
+
+struct hidl_flight_entry {
+    /* 0 for unused entries. */
+    uint64_t seq;
+    uint64_t stage_usec[HIDL_FLIGHT_STAGES];
+    uint32_t payload_hash;
+    uint32_t payload_len;
+    int32_t result;
+    uint8_t type;
+    char slot[HIDL_FLIGHT_SLOT_MAX];
+};
+
+struct hidl_flight {
+    uint64_t head;
+    uint32_t mask;
+    struct hidl_flight_entry *entries;
+};
+
+/* Number of entries for requested size, rounded up to a power of two. */
+static inline uint32_t hidl_flight_entries(uint32_t size) {
+    uint32_t n = 1;
+
+    while (n < size && n < (1U << 31))
+        n <<= 1;
+
+    return n;
+}
+
+/* entries must hold hidl_flight_entries(size) zeroed entries. */
+static inline void hidl_flight_init(struct hidl_flight *f, struct hidl_flight_entry *entries, uint32_t size) {
+    f->head = 0;
+    f->mask = hidl_flight_entries(size) - 1;
+    f->entries = entries;
+}
+
+/* FNV-1a, enough to tell payloads apart without storing them. */
+static inline uint32_t hidl_flight_hash(const char *payload, uint32_t *len) {
+    uint32_t hash = 2166136261U;
+    const char *p;
+
+    for (p = payload; *p; p++) {
+        hash ^= (uint8_t) *p;
+        hash *= 16777619U;
+    }
+
+    *len = (uint32_t) (p - payload);
+
+    return hash;
+}
+
+static inline void hidl_flight_record(struct hidl_flight *f, enum hidl_flight_type type, const char *slot,
+                                      const char *payload, const uint64_t stage_usec[HIDL_FLIGHT_STAGES],
+                                      int result) {
+    struct hidl_flight_entry *e;
+    uint64_t seq;
+
+    seq = __atomic_fetch_add(&f->head, 1, __ATOMIC_RELAXED);
+    e = &f->entries[seq & f->mask];
+
+    /* Mark the entry incomplete while it is being written. The fence keeps
+     * the writes below from becoming visible before the mark. */
+    __atomic_store_n(&e->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(e->stage_usec, stage_usec, sizeof(e->stage_usec));
+    e->payload_hash = payload ? hidl_flight_hash(payload, &e->payload_len) : 0;
+    if (!payload)
+        e->payload_len = 0;
+    e->result = result;
+    e->type = type;
+    memset(e->slot, 0, sizeof(e->slot));
+    if (slot)
+        strncpy(e->slot, slot, sizeof(e->slot) - 1);
+    __atomic_store_n(&e->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+/* Iterate entries from oldest to newest. Start with *iter = 0, each entry
+ * is copied to copy which is returned, NULL when done. Entries being
+ * written or overwritten while copying are skipped. */
+static inline const struct hidl_flight_entry *hidl_flight_next(const struct hidl_flight *f, uint64_t *iter,
+                                                               struct hidl_flight_entry *copy) {
+    uint64_t head = __atomic_load_n(&f->head, __ATOMIC_ACQUIRE);
+    const struct hidl_flight_entry *e;
+
+    if (*iter == 0 && head > (uint64_t) f->mask + 1)
+        *iter = head - f->mask - 1;
+
+    while (*iter < head) {
+        e = &f->entries[*iter & f->mask];
+        (*iter)++;
+        if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != *iter)
+            continue;
+        memcpy(copy, e, sizeof(*copy));
+        /* The fence keeps the copy from being read after the check. */
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&e->seq, __ATOMIC_RELAXED) == *iter)
+            return copy;
+    }
+
+    return NULL;
+}
+
+#endif
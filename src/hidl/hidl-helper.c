@@ -20,314 +20,361 @@
  * USA.
  */
 
-#include <gbinder.h>
 #include <glib-unix.h>
-#include <gutil_log.h>
 #include <gio/gio.h>
 
+#include <inttypes.h>
+
 #include "common.h"
+#include "hidl-flight.h"
+#include "hidl-helper.h"
+#include "hidl-probes.h"
+#include "hidl-transport.h"
+#include "hidl-wakeup.h"
 
 #define RET_OK                      (0)
 #define RET_INVARG                  (2)
 
-#define BINDER_DEVICE               GBINDER_DEFAULT_HWBINDER
-#define QCRIL_IFACE_1_0(x)          "vendor.qti.hardware.radio.am@1.0::" x
-#define QCRIL_AUDIO_1_0             QCRIL_IFACE_1_0("IQcRilAudio")
-#define QCRIL_AUDIO_CALLBACK_1_0    QCRIL_IFACE_1_0("IQcRilAudioCallback")
-
-#define OFONO_RIL_SUBSCRIPTION_CONF "/etc/ofono/ril_subscription.conf"
-#define OFONO_RIL_SUBSCRIPTION_D    "/etc/ofono/ril_subscription.d"
-#define OFONO_RIL_SLOTS_MAX         (4)
-#define CONNECT_RETRY_TIMEOUT_S     (1)
-
-#define DBGP(...)   do {                                                    \
-                        printf(__VA_ARGS__);                                \
-                        printf("\n");                                       \
-                        fflush(stdout);                                     \
-                    } while(0)
-
-#define DBG(...)    do {                                                    \
-                        if (gutil_log_default.level == GLOG_LEVEL_VERBOSE) {\
-                            if (standalone)                                 \
-                                GDEBUG(__VA_ARGS__);                        \
-                            else                                            \
-                                DBGP(__VA_ARGS__);                          \
-                        }                                                   \
-                    } while(0)
-
-#define ERR(...)    do {                                                    \
-                        if (standalone)                                     \
-                            GERR(__VA_ARGS__);                              \
-                        else                                                \
-                            DBGP(__VA_ARGS__);                              \
-                    } while(0)
-
-
-enum qcril_audio_methods {
-    QCRIL_AUDIO_SET_CALLBACK = GBINDER_FIRST_CALL_TRANSACTION,
-    QCRIL_AUDIO_SET_ERROR
-};
-
-enum qcril_audio_callback_methods {
-    QCRIL_AUDIO_CALLBACK_GET_PARAMETERS = GBINDER_FIRST_CALL_TRANSACTION,
-    QCRIL_AUDIO_CALLBACK_SET_PARAMETERS
+#define DEFAULT_TRANSPORT           "binder"
+
+#define CONFIG_RELOAD_DELAY_MS      (500)
+#define CONNECT_RETRY_MIN_S         (1)
+#define CONNECT_RETRY_MAX_S         (60)
+#define DBUS_UNIX_PATH              "unix:path="
+#define DEFAULT_FLIGHT_SIZE         (64)
+#define DEFAULT_FLIGHT_DEADLINE_MS  (1000)
+#define FLIGHT_DUMP_INTERVAL        (10 * G_TIME_SPAN_SECOND)
+
+/* Flight recorder stages of the helper. */
+enum flight_stage {
+    FLIGHT_RECEIVED,
+    FLIGHT_DBUS_SENT,
+    FLIGHT_DBUS_REPLIED,
+    FLIGHT_REPLIED
 };
 
-static gboolean standalone = FALSE;
+gboolean standalone = FALSE;
 static const char pname[] = HELPER_NAME;
 
 typedef struct app App;
 
-typedef struct am_client {
-    App *app;
-    char* fqname;
-    gchar* slot;
-    GBinderServiceManager* sm;
-    GBinderLocalObject* local;
-    GBinderRemoteObject* remote;
-    GBinderClient* client;
-    gulong wait_id;
-    gulong death_id;
-} AmClient;
-
 struct app {
     GMainLoop* loop;
     int ret;
-    GBinderServiceManager* sm;
+    HidlTransport* transport;
     GSList* clients;
+    gboolean running;
+    /* oFono configuration monitors, NULL if slots are given on command line. */
+    GSList* monitors;
+    guint reload_source;
     guint connect_source;
+    /* Watches the module socket while not connected, backoff in seconds
+     * for retries the socket events don't cover. */
+    GFileMonitor *connect_monitor;
+    guint connect_retry_s;
     GDBusConnection *dbus;
     gchar *address;
+
+    /* Flight recorder, entries NULL if disabled. */
+    struct hidl_flight flight;
+    struct hidl_flight_entry *flight_entries;
+    gint64 flight_deadline;
+    gint64 flight_dumped;
+    guint64 stages[HIDL_FLIGHT_STAGES];
+
+    /* Heartbeat to the module, only when run by it. */
+    guint heartbeat_source;
+    guint64 requests;
+    guint64 last_request;
+
+    /* setParameters with only keys matching these GPatternSpecs are
+     * acknowledged before they are applied. Given on command line or
+     * fetched from the module. */
+    GPtrArray *optimistic;
+    gboolean optimistic_fixed;
+    guint64 optimistic_sets;
+    guint64 optimistic_failed;
+
+    /* Request ids start over with every helper, the module tells helpers
+     * apart by this. */
+    guint64 boot_id;
+    /* Module keeps traces, fetched when connecting. */
+    gboolean trace;
 };
 
+typedef struct optimistic_set {
+    App *app;
+    gchar *key_value_pairs;
+} OptimisticSet;
+
 static gint
 dbus_get_parameters(
         App *app,
+        const HidlTransportRequest *request,
         const gchar *keys,
         gchar **reply_values);
 
 static gint
 dbus_set_parameters(
         App *app,
+        const HidlTransportRequest *request,
+        const gchar *key_value_pairs);
+
+static gint
+dbus_set_parameters_optimistic(
+        App *app,
+        const HidlTransportRequest *request,
         const gchar *key_value_pairs);
 
 static void
-am_client_registration_handler(
-        GBinderServiceManager* sm,
-        const char* name,
-        void* user_data);
+dbus_report_trace(
+        App *app,
+        const HidlTransportRequest *request);
 
 static void
-am_remote_died(
-        GBinderRemoteObject* obj,
-        void* user_data)
+flight_dump(
+        App *app,
+        const char *reason)
 {
-    AmClient* am = user_data;
+    struct hidl_flight_entry entry;
+    const struct hidl_flight_entry *e;
+    guint64 iter = 0;
+    guint64 received;
+
+    if (!app->flight_entries)
+        return;
+
+    DBGP("Flight recorder dump, %s:", reason);
+
+    while ((e = hidl_flight_next(&app->flight, &iter, &entry))) {
+        received = e->stage_usec[FLIGHT_RECEIVED];
+        DBGP("  #%" PRIu64 " %s slot=%s len=%u hash=%08x result=%d received=%" PRIu64
+             " dbus=+%" PRIu64 "..+%" PRIu64 " replied=+%" PRIu64,
+             e->seq,
+             e->type == HIDL_FLIGHT_SET_PARAMETERS ? "set" : "get",
+             e->slot[0] ? e->slot : "-",
+             e->payload_len,
+             e->payload_hash,
+             e->result,
+             received,
+             e->stage_usec[FLIGHT_DBUS_SENT] ? e->stage_usec[FLIGHT_DBUS_SENT] - received : 0,
+             e->stage_usec[FLIGHT_DBUS_REPLIED] ? e->stage_usec[FLIGHT_DBUS_REPLIED] - received : 0,
+             e->stage_usec[FLIGHT_REPLIED] - received);
+    }
+}
 
-    DBG("%s has died", am->fqname);
-    gbinder_remote_object_unref(am->remote);
-    am->remote = NULL;
+static void
+flight_begin(
+        App *app,
+        const HidlTransportRequest *request)
+{
+    memset(app->stages, 0, sizeof(app->stages));
+    app->stages[FLIGHT_RECEIVED] = request->received;
+    app->requests++;
+    app->last_request = request->id;
+}
 
-    /* Wait for it to re-appear */
-    am->wait_id = gbinder_servicemanager_add_registration_handler(am->sm,
-        am->fqname, am_client_registration_handler, am);
+static void
+flight_end(
+        App *app,
+        enum hidl_flight_type type,
+        const char *slot,
+        const char *payload,
+        gint result)
+{
+    gint64 now;
+
+    if (!app->flight_entries)
+        return;
+
+    now = g_get_monotonic_time();
+    app->stages[FLIGHT_REPLIED] = now;
+    hidl_flight_record(&app->flight, type, slot, payload, app->stages, result);
+
+    /* Automatic dumps are rate limited so that a stuck PulseAudio can't
+     * flood the log. */
+    if (app->flight_deadline &&
+        now - (gint64) app->stages[FLIGHT_RECEIVED] > app->flight_deadline &&
+        (!app->flight_dumped || now >= app->flight_dumped + FLIGHT_DUMP_INTERVAL)) {
+        app->flight_dumped = now;
+        flight_dump(app, "request deadline exceeded");
+    }
 }
 
-/* IQcRilAudioCallback::getParameters(string str) generates (string) */
 static gboolean
-am_client_callback_get_parameters(
-        AmClient* am,
-        const char* str,
-        GBinderLocalReply* reply)
-{
-    if (str) {
-        gchar* result = NULL;
-        dbus_get_parameters(am->app, str, &result);
-
-        if (result) {
-            GBinderWriter writer;
-            gbinder_local_reply_init_writer(reply, &writer);
-            gbinder_writer_append_int32(&writer, 0 /* OK */);
-            gbinder_writer_append_hidl_string(&writer, result);
-
-            return TRUE;
-        }
-    }
+app_get_parameters(
+        const HidlTransportRequest *request,
+        const char *keys,
+        gchar **reply_values,
+        gpointer user_data)
+{
+    App *app = user_data;
+    gint ret;
+
+    flight_begin(app, request);
+    ret = dbus_get_parameters(app, request, keys, reply_values);
+    flight_end(app, HIDL_FLIGHT_GET_PARAMETERS, request->slot, keys, ret);
+    dbus_report_trace(app, request);
 
-    return FALSE;
+    return ret == 0;
 }
 
-/* IQcRilAudioCallback::setParameters(string str) generates (int32_t) */
-static gboolean
-am_client_callback_set_parameters(
-        AmClient* am,
-        const char* str,
-        GBinderLocalReply* reply)
+static void
+app_set_optimistic_keys(
+        App *app,
+        const char *keys)
 {
-    if (str) {
-        GBinderWriter writer;
-        guint32 result = 0;
+    gchar **patterns;
+    gint i;
 
-        result = dbus_set_parameters(am->app, str);
-        gbinder_local_reply_init_writer(reply, &writer);
-        gbinder_writer_append_int32(&writer, 0 /* OK */);
-        gbinder_writer_append_int32(&writer, result);
+    g_ptr_array_set_size(app->optimistic, 0);
 
-        return TRUE;
+    patterns = g_strsplit_set(keys ? keys : "", ",;", -1);
+    for (i = 0; patterns[i]; i++) {
+        g_strstrip(patterns[i]);
+        if (*patterns[i])
+            g_ptr_array_add(app->optimistic, g_pattern_spec_new(patterns[i]));
     }
+    g_strfreev(patterns);
 
-    return FALSE;
-}
-
-static GBinderLocalReply*
-am_client_callback(
-        GBinderLocalObject* obj,
-        GBinderRemoteRequest* req,
-        guint code,
-        guint flags,
-        int* status,
-        void* user_data)
-{
-    AmClient* am = user_data;
-    const char* iface = gbinder_remote_request_interface(req);
-
-    if (!g_strcmp0(iface, QCRIL_AUDIO_CALLBACK_1_0)) {
-        GBinderReader reader;
-        GBinderLocalReply* reply = gbinder_local_object_new_reply(obj);
-        const char* str;
-
-        gbinder_remote_request_init_reader(req, &reader);
-        str = gbinder_reader_read_hidl_string_c(&reader);
-        switch (code) {
-        case QCRIL_AUDIO_CALLBACK_GET_PARAMETERS:
-            DBG("IQcRilAudioCallback::getParameters %s %s", am->slot, str);
-            if (am_client_callback_get_parameters(am, str, reply)) {
-                return reply;
-            }
-            break;
-        case QCRIL_AUDIO_CALLBACK_SET_PARAMETERS:
-            DBG("IQcRilAudioCallback::setParameters %s %s", am->slot, str);
-            if (am_client_callback_set_parameters(am, str, reply)) {
-                return reply;
-            }
-            break;
-        }
-        /* We haven't used the reply */
-        gbinder_local_reply_unref(reply);
-    }
-    ERR("Unexpected callback %s %u", iface, code);
-    *status = GBINDER_STATUS_FAILED;
-    return NULL;
+    if (app->optimistic->len)
+        DBG("Acknowledge setParameters of %s before applying", keys);
 }
 
+/* TRUE if every key of key_value_pairs is optimistic. */
 static gboolean
-am_client_connect(
-        AmClient* am)
-{
-    int status = 0;
-    am->remote = gbinder_servicemanager_get_service_sync(am->sm,
-        am->fqname, &status); /* auto-released reference */
-
-    if (am->remote) {
-        GBinderLocalRequest* req;
-
-        DBG("Connected to %s", am->fqname);
-        gbinder_remote_object_ref(am->remote);
-        am->client = gbinder_client_new(am->remote, QCRIL_AUDIO_1_0);
-        am->death_id = gbinder_remote_object_add_death_handler(am->remote,
-            am_remote_died, am);
-        am->local = gbinder_servicemanager_new_local_object(am->sm,
-            QCRIL_AUDIO_CALLBACK_1_0, am_client_callback, am);
-
-        /* oneway IQcRilAudio::setCallback(IQcRilAudioCallback) */
-        req = gbinder_client_new_request(am->client);
-        gbinder_local_request_append_local_object(req, am->local);
-        status = gbinder_client_transact_sync_oneway(am->client,
-            QCRIL_AUDIO_SET_CALLBACK, req);
-        gbinder_local_request_unref(req);
-        DBG("setCallback %s status %d", am->slot, status);
-        return TRUE;
+app_is_optimistic(
+        App *app,
+        const char *key_value_pairs)
+{
+    gchar **pairs;
+    gboolean optimistic = TRUE;
+    gint i;
+    guint j;
+
+    if (!app->optimistic->len)
+        return FALSE;
+
+    pairs = g_strsplit(key_value_pairs, ";", -1);
+    for (i = 0; optimistic && pairs[i]; i++) {
+        gchar *value = strchr(pairs[i], '=');
+
+        if (value)
+            *value = '\0';
+
+        optimistic = FALSE;
+        for (j = 0; !optimistic && j < app->optimistic->len; j++)
+            optimistic = g_pattern_match_string(g_ptr_array_index(app->optimistic, j), pairs[i]);
     }
-    return FALSE;
+    g_strfreev(pairs);
+
+    return optimistic && i > 0;
 }
 
-static void
-am_client_registration_handler(
-        GBinderServiceManager* sm,
-        const char* name,
-        void* user_data)
+static gint
+app_set_parameters(
+        const HidlTransportRequest *request,
+        const char *key_value_pairs,
+        gpointer user_data)
 {
-    AmClient* am = user_data;
+    App *app = user_data;
+    gint ret;
+
+    flight_begin(app, request);
+    /* Later requests are sent on the same connection, so the module still
+     * handles them in order. */
+    if (app_is_optimistic(app, key_value_pairs))
+        ret = dbus_set_parameters_optimistic(app, request, key_value_pairs);
+    else
+        ret = dbus_set_parameters(app, request, key_value_pairs);
+    flight_end(app, HIDL_FLIGHT_SET_PARAMETERS, request->slot, key_value_pairs, ret);
+    dbus_report_trace(app, request);
 
-    if (!strcmp(name, am->fqname) && am_client_connect(am)) {
-        DBG("%s has reanimated", am->fqname);
-        gbinder_servicemanager_remove_handler(am->sm, am->wait_id);
-        am->wait_id = 0;
-    } else {
-        DBG("%s appeared", name);
-    }
+    return ret;
 }
 
-static AmClient*
-am_client_new(
-        App *app,
-        const char* slot)
+static void
+app_quit(
+        gpointer user_data)
 {
-    AmClient* am = g_new0(AmClient, 1);
+    App* app = user_data;
 
-    am->app = app;
-    am->slot = g_strdup(slot);
-    am->fqname = g_strconcat(QCRIL_AUDIO_1_0, "/", slot, NULL);
-    am->sm = gbinder_servicemanager_ref(app->sm);
-    return am;
+    g_main_loop_quit(app->loop);
 }
 
-static void
-am_client_connect_all(
-        GSList *clients)
+static const HidlTransportHandler app_transport_handler = {
+    .get_parameters = app_get_parameters,
+    .set_parameters = app_set_parameters,
+    .quit = app_quit
+};
+
+static gboolean
+app_signal(
+        gpointer user_data)
 {
-    GSList *i;
+    App* app = user_data;
+    gint64 wakeup = hidl_wakeup_begin();
 
-    for (i = clients; i; i = i->next) {
-        AmClient *am = i->data;
+    DBG("Caught signal, %s shutting down...", pname);
+    g_main_loop_quit(app->loop);
+    hidl_wakeup_end(HIDL_WAKEUP_SIGNAL, wakeup);
+    return G_SOURCE_CONTINUE;
+}
 
-        if (!am_client_connect(am)) {
-            DBG("Waiting for %s", am->fqname);
-            am->wait_id = gbinder_servicemanager_add_registration_handler(am->sm,
-                am->fqname, am_client_registration_handler, am);
-        }
-    }
+static gboolean
+app_signal_dump(
+        gpointer user_data)
+{
+    App* app = user_data;
+    gint64 wakeup = hidl_wakeup_begin();
+
+    flight_dump(app, "requested");
+    hidl_wakeup_end(HIDL_WAKEUP_SIGNAL, wakeup);
+    return G_SOURCE_CONTINUE;
 }
 
-static void
-am_client_free(
-        gpointer data)
+/* Wakeups and main thread CPU time per source as
+ * source:count:usec[,source:count:usec...] */
+static gchar*
+app_wakeups(void)
 {
-    AmClient* am = data;
+    GString *str = g_string_new(NULL);
+    HidlWakeupSource source;
 
-    if (am->remote) {
-        gbinder_remote_object_remove_handler(am->remote, am->death_id);
-        gbinder_remote_object_unref(am->remote);
-    }
-    if (am->local) {
-        gbinder_local_object_drop(am->local);
-        gbinder_client_unref(am->client);
+    for (source = 0; source < HIDL_WAKEUP_SOURCES; source++) {
+        const HidlWakeupStats *stats = hidl_wakeup_stats(source);
+
+        g_string_append_printf(str, "%s%s:%" PRIu64 ":%" PRId64,
+                               str->len ? "," : "",
+                               hidl_wakeup_source_name(source),
+                               stats->count,
+                               stats->cpu_usec);
     }
-    gbinder_servicemanager_remove_handler(am->sm, am->wait_id);
-    gbinder_servicemanager_unref(am->sm);
-    g_free(am->fqname);
-    g_free(am->slot);
-    g_free(am);
+
+    return g_string_free(str, FALSE);
 }
 
 static gboolean
-app_signal(
+app_heartbeat(
         gpointer user_data)
 {
     App* app = user_data;
-
-    DBG("Caught signal, %s shutting down...", pname);
-    g_main_loop_quit(app->loop);
+    gint64 wakeup = hidl_wakeup_begin();
+    gchar *wakeups = app_wakeups();
+
+    DBGP(HELPER_HEARTBEAT " requests=%" PRIu64 " last_id=%" PRIu64 " optimistic=%" PRIu64
+         " optimistic_failed=%" PRIu64 " dbus=%s slots=%u "
+         HELPER_HEARTBEAT_WAKEUPS "%s cpu=%" PRId64,
+         app->requests,
+         app->last_request,
+         app->optimistic_sets,
+         app->optimistic_failed,
+         app->dbus ? "connected" : "disconnected",
+         g_slist_length(app->clients),
+         wakeups,
+         hidl_wakeup_process_cpu_usec());
+    g_free(wakeups);
+    hidl_wakeup_end(HIDL_WAKEUP_TIMER, wakeup);
     return G_SOURCE_CONTINUE;
 }
 
@@ -337,17 +384,61 @@ app_run(
 {
     guint sigtrm = g_unix_signal_add(SIGTERM, app_signal, app);
     guint sigint = g_unix_signal_add(SIGINT, app_signal, app);
+    guint sigusr1 = g_unix_signal_add(SIGUSR1, app_signal_dump, app);
+    GSList *i;
+
+    app->running = TRUE;
+    for (i = app->clients; i; i = i->next)
+        hidl_transport_slot_connect(i->data);
+
+    /* Module arms its watchdog on the first heartbeat, so waiting for the
+     * transport before this doesn't count. */
+    if (!standalone) {
+        app_heartbeat(app);
+        /* Second granularity lets GLib wake up for it together with other
+         * timers. */
+        app->heartbeat_source = g_timeout_add_seconds(HELPER_HEARTBEAT_INTERVAL_MS / 1000, app_heartbeat, app);
+    }
 
-    am_client_connect_all(app->clients);
     g_main_loop_run(app->loop);
+
+    if (app->heartbeat_source)
+        g_source_remove(app->heartbeat_source);
     g_source_remove(sigtrm);
     g_source_remove(sigint);
+    g_source_remove(sigusr1);
+}
+
+static GDBusMessage*
+dbus_traced_message_new(
+        App *app,
+        const gchar *method,
+        const HidlTransportRequest *request,
+        const gchar *args)
+{
+    GDBusMessage *msg;
+
+    msg = g_dbus_message_new_method_call(NULL,
+                                         HIDL_PASSTHROUGH_PATH,
+                                         HIDL_PASSTHROUGH_IFACE,
+                                         method);
+    app->stages[FLIGHT_DBUS_SENT] = g_get_monotonic_time();
+    g_dbus_message_set_body(msg, g_variant_new("(ttstts)",
+                                               app->boot_id,
+                                               request->id,
+                                               request->slot ? request->slot : "",
+                                               (guint64) request->received,
+                                               app->stages[FLIGHT_DBUS_SENT],
+                                               args));
+
+    return msg;
 }
 
 static gint
 dbus_call(
         App *app,
         const gchar *method,
+        const HidlTransportRequest *request,
         const gchar *args,
         gchar **reply_str)
 {
@@ -358,6 +449,7 @@ dbus_call(
 
     g_assert(app);
     g_assert(method);
+    g_assert(request);
     g_assert(args);
 
     if (reply_str)
@@ -368,11 +460,8 @@ dbus_call(
         goto out;
     }
 
-    msg = g_dbus_message_new_method_call(NULL,
-                                         HIDL_PASSTHROUGH_PATH,
-                                         HIDL_PASSTHROUGH_IFACE,
-                                         method);
-    g_dbus_message_set_body(msg, g_variant_new("(s)", args));
+    msg = dbus_traced_message_new(app, method, request, args);
+    HIDL_PROBE2(dbus_send, method, request->id);
     reply = g_dbus_connection_send_message_with_reply_sync(app->dbus,
                                                            msg,
                                                            G_DBUS_SEND_MESSAGE_FLAGS_NONE,
@@ -380,6 +469,10 @@ dbus_call(
                                                            NULL, /* out_serial */
                                                            NULL, /* cancellable */
                                                            &error);
+    app->stages[FLIGHT_DBUS_REPLIED] = g_get_monotonic_time();
+    HIDL_PROBE4(dbus_reply, method, request->id,
+                reply && g_dbus_message_get_message_type(reply) != G_DBUS_MESSAGE_TYPE_ERROR ? 0 : -1,
+                app->stages[FLIGHT_DBUS_REPLIED] - app->stages[FLIGHT_DBUS_SENT]);
     if (!reply) {
         ERR("Failed to call %s(): %s", method, error->message);
         goto out;
@@ -408,17 +501,19 @@ out:
 static gint
 dbus_set_parameters(
         App *app,
+        const HidlTransportRequest *request,
         const gchar *key_value_pairs)
 {
     g_assert(app);
     g_assert(key_value_pairs);
 
-    return dbus_call(app, HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS, key_value_pairs, NULL);
+    return dbus_call(app, HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS_TRACED, request, key_value_pairs, NULL);
 }
 
 static gint
 dbus_get_parameters(
         App *app,
+        const HidlTransportRequest *request,
         const gchar *keys,
         gchar **reply_values)
 {
@@ -426,14 +521,199 @@ dbus_get_parameters(
     g_assert(keys);
     g_assert(reply_values);
 
-    return dbus_call(app, HIDL_PASSTHROUGH_METHOD_GET_PARAMETERS, keys, reply_values);
+    return dbus_call(app, HIDL_PASSTHROUGH_METHOD_GET_PARAMETERS_TRACED, request, keys, reply_values);
 }
 
-static gboolean
-dbus_init_cb(
+static void
+dbus_optimistic_reply(
+        GObject *source,
+        GAsyncResult *res,
         gpointer user_data)
 {
-    App *app = user_data;
+    OptimisticSet *set = user_data;
+    GDBusMessage *reply;
+    GError *error = NULL;
+    gint64 wakeup = hidl_wakeup_begin();
+
+    reply = g_dbus_connection_send_message_with_reply_finish(G_DBUS_CONNECTION(source), res, &error);
+
+    if (!reply || g_dbus_message_get_message_type(reply) == G_DBUS_MESSAGE_TYPE_ERROR) {
+        set->app->optimistic_failed++;
+        ERR("Acknowledged setParameters(%s) failed: %s (%" PRIu64 " failures)",
+            set->key_value_pairs,
+            error ? error->message : g_dbus_message_get_error_name(reply),
+            set->app->optimistic_failed);
+    }
+
+    if (error)
+        g_error_free(error);
+    if (reply)
+        g_object_unref(reply);
+    g_free(set->key_value_pairs);
+    g_free(set);
+    hidl_wakeup_end(HIDL_WAKEUP_DBUS, wakeup);
+}
+
+/* Send set_parameters without waiting for the reply, failures are only
+ * logged and counted. */
+static gint
+dbus_set_parameters_optimistic(
+        App *app,
+        const HidlTransportRequest *request,
+        const gchar *key_value_pairs)
+{
+    GDBusMessage *msg;
+    OptimisticSet *set;
+
+    if (!app->dbus) {
+        ERR("No connection (%s)", app->address);
+        return 1;
+    }
+
+    set = g_new0(OptimisticSet, 1);
+    set->app = app;
+    set->key_value_pairs = g_strdup(key_value_pairs);
+
+    msg = dbus_traced_message_new(app, HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS_TRACED, request, key_value_pairs);
+    HIDL_PROBE2(dbus_send, HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS_TRACED, request->id);
+    g_dbus_connection_send_message_with_reply(app->dbus,
+                                              msg,
+                                              G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                              -1,
+                                              NULL, /* out_serial */
+                                              NULL, /* cancellable */
+                                              dbus_optimistic_reply,
+                                              set);
+    g_object_unref(msg);
+    app->optimistic_sets++;
+
+    return 0;
+}
+
+/* Optimistic keys are configured in the module unless given on command
+ * line. */
+static void
+dbus_update_optimistic_keys(
+        App *app)
+{
+    GVariant *reply;
+    GError *error = NULL;
+    const gchar *keys;
+
+    if (app->optimistic_fixed)
+        return;
+
+    reply = g_dbus_connection_call_sync(app->dbus,
+                                        NULL,
+                                        HIDL_PASSTHROUGH_PATH,
+                                        HIDL_PASSTHROUGH_IFACE,
+                                        HIDL_PASSTHROUGH_METHOD_GET_OPTIMISTIC_KEYS,
+                                        NULL,
+                                        G_VARIANT_TYPE("(s)"),
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1,
+                                        NULL,
+                                        &error);
+    if (!reply) {
+        ERR("Failed to call %s(): %s", HIDL_PASSTHROUGH_METHOD_GET_OPTIMISTIC_KEYS, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    g_variant_get(reply, "(&s)", &keys);
+    app_set_optimistic_keys(app, keys);
+    g_variant_unref(reply);
+}
+
+/* Reports are only sent when the module keeps traces. */
+static void
+dbus_update_trace(
+        App *app)
+{
+    GVariant *reply;
+    GError *error = NULL;
+    guint32 size;
+
+    app->trace = FALSE;
+
+    reply = g_dbus_connection_call_sync(app->dbus,
+                                        NULL,
+                                        HIDL_PASSTHROUGH_PATH,
+                                        HIDL_PASSTHROUGH_IFACE,
+                                        HIDL_PASSTHROUGH_METHOD_GET_TRACE_SIZE,
+                                        NULL,
+                                        G_VARIANT_TYPE("(u)"),
+                                        G_DBUS_CALL_FLAGS_NONE,
+                                        -1,
+                                        NULL,
+                                        &error);
+    if (!reply) {
+        ERR("Failed to call %s(): %s", HIDL_PASSTHROUGH_METHOD_GET_TRACE_SIZE, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    g_variant_get(reply, "(u)", &size);
+    app->trace = size > 0;
+    g_variant_unref(reply);
+}
+
+/* Complete the stage timing of the request in module with the time the
+ * reply was handed back to the transport. No reply is expected so this
+ * doesn't add a round trip to the next request. */
+static void
+dbus_report_trace(
+        App *app,
+        const HidlTransportRequest *request)
+{
+    GDBusMessage *msg;
+    GError *error = NULL;
+
+    if (!app->dbus || !app->trace)
+        return;
+
+    msg = g_dbus_message_new_method_call(NULL,
+                                         HIDL_PASSTHROUGH_PATH,
+                                         HIDL_PASSTHROUGH_IFACE,
+                                         HIDL_PASSTHROUGH_METHOD_REPORT_TRACE);
+    g_dbus_message_set_flags(msg, G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED);
+    g_dbus_message_set_body(msg, g_variant_new("(ttt)",
+                                               app->boot_id,
+                                               request->id,
+                                               (guint64) g_get_monotonic_time()));
+
+    if (!g_dbus_connection_send_message(app->dbus,
+                                        msg,
+                                        G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                        NULL, /* out_serial */
+                                        &error)) {
+        ERR("Failed to call %s(): %s", HIDL_PASSTHROUGH_METHOD_REPORT_TRACE, error->message);
+        g_error_free(error);
+    }
+
+    g_object_unref(msg);
+}
+
+static void
+dbus_connect_stop(
+        App *app)
+{
+    if (app->connect_source) {
+        g_source_remove(app->connect_source);
+        app->connect_source = 0;
+    }
+
+    if (app->connect_monitor) {
+        g_file_monitor_cancel(app->connect_monitor);
+        g_object_unref(app->connect_monitor);
+        app->connect_monitor = NULL;
+    }
+}
+
+static gboolean
+dbus_connect(
+        App *app)
+{
     GError *error = NULL;
 
     app->dbus = g_dbus_connection_new_for_address_sync(app->address,
@@ -442,31 +722,118 @@ dbus_init_cb(
                                                        NULL,    /* cancellable */
                                                        &error);
 
-
     if (!app->dbus) {
-        DBG("Could not connect to %s, try again in %d seconds...", app->address, CONNECT_RETRY_TIMEOUT_S);
-        return G_SOURCE_CONTINUE;
-    }
-
-    if (error) {
-        DBG("Could not connect to %s: %s", app->address, error->message);
-        g_error_free(error);
-        return G_SOURCE_CONTINUE;
+        DBG("Could not connect to %s: %s", app->address, error ? error->message : "unknown error");
+        if (error)
+            g_error_free(error);
+        return FALSE;
     }
 
     DBG("Connected to DBus socket %s", app->address);
+    dbus_connect_stop(app);
+    dbus_update_optimistic_keys(app);
+    dbus_update_trace(app);
+    return TRUE;
+}
+
+static void
+dbus_connect_retry(
+        App *app);
+
+static gboolean
+dbus_init_cb(
+        gpointer user_data)
+{
+    App *app = user_data;
+    gint64 wakeup = hidl_wakeup_begin();
+
     app->connect_source = 0;
+    if (!dbus_connect(app))
+        dbus_connect_retry(app);
+
+    hidl_wakeup_end(HIDL_WAKEUP_TIMER, wakeup);
     return G_SOURCE_REMOVE;
 }
 
+/* Module creates its socket after spawning us, so usually the first retry
+ * is triggered by the socket appearing instead of a timer. */
 static void
-dbus_deinit(
-        App *app)
+dbus_socket_changed(
+        GFileMonitor *monitor,
+        GFile *file,
+        GFile *other_file,
+        GFileMonitorEvent event,
+        gpointer user_data)
 {
+    App *app = user_data;
+    gint64 wakeup;
+
+    if (event != G_FILE_MONITOR_EVENT_CREATED || app->dbus)
+        return;
+
+    wakeup = hidl_wakeup_begin();
+    DBG("DBus socket of %s appeared", app->address);
     if (app->connect_source) {
         g_source_remove(app->connect_source);
         app->connect_source = 0;
     }
+    app->connect_retry_s = CONNECT_RETRY_MIN_S;
+    if (!dbus_connect(app))
+        dbus_connect_retry(app);
+
+    hidl_wakeup_end(HIDL_WAKEUP_DBUS, wakeup);
+}
+
+static void
+dbus_watch_socket(
+        App *app)
+{
+    const gchar *path;
+    gchar *socket_path;
+    GFile *file;
+    GError *error = NULL;
+
+    /* Only plain unix socket paths can be watched, abstract sockets and
+     * other transports are left to the timed retries. */
+    if (!g_str_has_prefix(app->address, DBUS_UNIX_PATH))
+        return;
+
+    path = app->address + strlen(DBUS_UNIX_PATH);
+    socket_path = g_strndup(path, strcspn(path, ",;"));
+    file = g_file_new_for_path(socket_path);
+
+    app->connect_monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &error);
+    if (app->connect_monitor)
+        g_signal_connect(app->connect_monitor, "changed", G_CALLBACK(dbus_socket_changed), app);
+    else {
+        DBG("Cannot watch %s: %s", socket_path, error->message);
+        g_error_free(error);
+    }
+
+    g_object_unref(file);
+    g_free(socket_path);
+}
+
+static void
+dbus_connect_retry(
+        App *app)
+{
+    if (!app->connect_monitor)
+        dbus_watch_socket(app);
+
+    /* Socket may exist before the module listens on it, so keep retrying
+     * also with the monitor, with backoff to stay asleep when the module
+     * isn't coming. */
+    DBG("Try again in %u seconds...", app->connect_retry_s);
+    app->connect_source = g_timeout_add_seconds(app->connect_retry_s, dbus_init_cb, app);
+    app->connect_retry_s = MIN(app->connect_retry_s * 2, CONNECT_RETRY_MAX_S);
+}
+
+static void
+dbus_deinit(
+        App *app)
+{
+    dbus_connect_stop(app);
 
     if (app->dbus) {
         g_object_unref(app->dbus);
@@ -480,53 +847,64 @@ dbus_init_delayed(
 {
     dbus_deinit(app);
     DBG("Using address: %s", app->address);
-    app->connect_source = g_timeout_add_seconds(1, dbus_init_cb, app);
+    app->connect_retry_s = CONNECT_RETRY_MIN_S;
+    app->connect_source = g_idle_add(dbus_init_cb, app);
 }
 
 static void
-am_client_remove_slot(
+app_remove_slot(
         App *app,
         const gchar *slot_name)
 {
     GSList *i;
 
     for (i = app->clients; i; i = i->next) {
-        AmClient *am = i->data;
+        HidlTransportSlot *slot = i->data;
 
-        if (!g_strcmp0(slot_name, am->slot)) {
+        if (!g_strcmp0(slot_name, slot->name)) {
             app->clients = g_slist_delete_link(app->clients, i);
-            am_client_free(am);
+            hidl_transport_slot_free(slot);
             break;
         }
     }
 }
 
 static void
-parse_key(
+app_add_slot(
         App *app,
+        const gchar *slot_name)
+{
+    app_remove_slot(app, slot_name);
+    app->clients = g_slist_append(app->clients,
+                                  hidl_transport_slot_new(app->transport, slot_name));
+}
+
+/* Add slot name of config group to slots if it has a binder transport. */
+static void
+parse_group(
+        GHashTable *slots,
         GKeyFile *config,
-        const char *key)
+        const char *group)
 {
-    if (g_key_file_has_key(config, key, "transport", NULL)) {
+    if (g_key_file_has_key(config, group, "transport", NULL)) {
         gchar *value;
         gchar *name;
 
-        value = g_key_file_get_value(config, key, "transport", NULL);
+        value = g_key_file_get_value(config, group, "transport", NULL);
         if (g_str_has_prefix(value, "binder:name")) {
             name = g_strrstr(value, "=");
             if (name && strlen(name) > 1) {
                 name++;
-                am_client_remove_slot(app, name);
-                app->clients = g_slist_append(app->clients,
-                                              am_client_new(app, name));
+                g_hash_table_add(slots, g_strdup(name));
             }
         }
+        g_free(value);
     }
 }
 
 static void
 parse_slots_from_file(
-        App *app,
+        GHashTable *slots,
         const gchar *filename)
 {
     GKeyFile *config;
@@ -536,35 +914,155 @@ parse_slots_from_file(
                                   filename,
                                   G_KEY_FILE_NONE,
                                   NULL)) {
+        gchar **groups;
         gint i;
-        for (i = 0; i < OFONO_RIL_SLOTS_MAX; i++) {
-            gchar *key = g_strdup_printf("ril_%d", i);
-            parse_key(app, config, key);
-            g_free(key);
-        }
+
+        groups = g_key_file_get_groups(config, NULL);
+        for (i = 0; groups[i]; i++)
+            parse_group(slots, config, groups[i]);
+        g_strfreev(groups);
     }
 
     g_key_file_unref(config);
 }
 
-static void
-app_parse_all_slots(
-        App *app)
+/* Returns set of slot names configured for oFono. */
+static GHashTable*
+parse_all_slots(void)
 {
+    GHashTable *slots;
     GDir *config_dir;
 
-    parse_slots_from_file(app, OFONO_RIL_SUBSCRIPTION_CONF);
+    slots = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+
+    parse_slots_from_file(slots, OFONO_RIL_SUBSCRIPTION_CONF);
     if ((config_dir = g_dir_open(OFONO_RIL_SUBSCRIPTION_D, 0, NULL))) {
         const gchar *filename;
         while ((filename = g_dir_read_name(config_dir))) {
             if (g_str_has_suffix(filename, ".conf")) {
                 gchar *path = g_strdup_printf(OFONO_RIL_SUBSCRIPTION_D "/%s", filename);
-                parse_slots_from_file(app, path);
+                parse_slots_from_file(slots, path);
                 g_free(path);
             }
         }
         g_dir_close(config_dir);
     }
+
+    return slots;
+}
+
+/* Add and remove slots to match oFono configuration, leaving slots that
+ * didn't change untouched. */
+static void
+app_sync_slots(
+        App *app)
+{
+    GHashTable *slots;
+    GHashTableIter iter;
+    gpointer name;
+    GSList *i;
+    GSList *next;
+
+    slots = parse_all_slots();
+
+    for (i = app->clients; i; i = next) {
+        HidlTransportSlot *slot = i->data;
+
+        next = i->next;
+        if (!g_hash_table_remove(slots, slot->name)) {
+            DBG("Slot %s removed", slot->name);
+            app->clients = g_slist_delete_link(app->clients, i);
+            hidl_transport_slot_free(slot);
+        }
+    }
+
+    /* Remaining ones are new. */
+    g_hash_table_iter_init(&iter, slots);
+    while (g_hash_table_iter_next(&iter, &name, NULL)) {
+        HidlTransportSlot *slot = hidl_transport_slot_new(app->transport, name);
+
+        DBG("Slot %s added", (const char *) name);
+        app->clients = g_slist_append(app->clients, slot);
+        if (app->running)
+            hidl_transport_slot_connect(slot);
+    }
+
+    g_hash_table_unref(slots);
+
+    if (!app->clients) {
+        DBG("No slots configured, exiting");
+        app->ret = HELPER_EXIT_NO_SLOTS;
+        if (app->running)
+            g_main_loop_quit(app->loop);
+    }
+}
+
+static gboolean
+app_reload_cb(
+        gpointer user_data)
+{
+    App *app = user_data;
+    gint64 wakeup = hidl_wakeup_begin();
+
+    app->reload_source = 0;
+    DBG("oFono configuration changed");
+    app_sync_slots(app);
+
+    hidl_wakeup_end(HIDL_WAKEUP_TIMER, wakeup);
+    return G_SOURCE_REMOVE;
+}
+
+static void
+app_config_changed(
+        GFileMonitor *monitor,
+        GFile *file,
+        GFile *other_file,
+        GFileMonitorEvent event,
+        gpointer user_data)
+{
+    App *app = user_data;
+    gint64 wakeup = hidl_wakeup_begin();
+
+    /* Editors and package managers touch files several times in a row,
+     * reload once things have settled. */
+    if (app->reload_source)
+        g_source_remove(app->reload_source);
+    app->reload_source = g_timeout_add(CONFIG_RELOAD_DELAY_MS, app_reload_cb, app);
+    hidl_wakeup_end(HIDL_WAKEUP_CONFIG, wakeup);
+}
+
+static void
+app_watch_path(
+        App *app,
+        const gchar *path,
+        gboolean directory)
+{
+    GFile *file = g_file_new_for_path(path);
+    GFileMonitor *monitor;
+    GError *error = NULL;
+
+    if (directory)
+        monitor = g_file_monitor_directory(file, G_FILE_MONITOR_NONE, NULL, &error);
+    else
+        monitor = g_file_monitor_file(file, G_FILE_MONITOR_NONE, NULL, &error);
+
+    if (monitor) {
+        g_signal_connect(monitor, "changed", G_CALLBACK(app_config_changed), app);
+        app->monitors = g_slist_prepend(app->monitors, monitor);
+    } else {
+        ERR("Cannot watch %s: %s", path, error->message);
+        g_error_free(error);
+    }
+
+    g_object_unref(file);
+}
+
+static void
+app_watch_slots(
+        App *app)
+{
+    app_watch_path(app, OFONO_RIL_SUBSCRIPTION_CONF, FALSE);
+    app_watch_path(app, OFONO_RIL_SUBSCRIPTION_D, TRUE);
 }
 
 static gboolean
@@ -578,12 +1076,29 @@ app_init(
     GError* error = NULL;
     GOptionContext* options;
     gboolean verbose = FALSE;
+    gchar *transport = NULL;
+    gchar **slots = NULL;
+    gint flight_size = DEFAULT_FLIGHT_SIZE;
+    gint flight_deadline = DEFAULT_FLIGHT_DEADLINE_MS;
+    gchar *optimistic_keys = NULL;
+    const HidlTransportDriver *driver = NULL;
 
     GOptionEntry entries[] = {
         { "standalone", 's', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
           &standalone, "Standalone execution.", NULL },
         { "verbose", 'v', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
           &verbose, "Enable verbose output", NULL },
+        { "transport", 't', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,
+          &transport, "Transport to use, binder (default) or fake", "NAME" },
+        { "slot", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY,
+          &slots, "Serve given slot instead of ones found from oFono configuration, may be repeated", "NAME" },
+        { "flight-size", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+          &flight_size, "Recent requests kept in flight recorder, 0 disables (default 64)", "N" },
+        { "flight-deadline", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+          &flight_deadline, "Dump flight recorder when a request takes longer, 0 disables (default 1000)", "MS" },
+        { "optimistic-keys", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING,
+          &optimistic_keys, "Acknowledge setParameters of these keys before applying, overrides module configuration",
+          "KEY[,KEY...]" },
         { NULL, 0, 0, 0, NULL, NULL, NULL }
     };
 
@@ -595,18 +1110,45 @@ app_init(
     log_init(&level);
 
     g_option_context_add_main_entries(options, entries, NULL);
+    hidl_transport_add_option_groups(options);
     if (g_option_context_parse(options, &argc, &argv, &error)) {
         if (verbose || level == PULSE_LOG_LEVEL_DEBUG)
             gutil_log_default.level = GLOG_LEVEL_VERBOSE;
 
-        app->loop = g_main_loop_new(NULL, TRUE);
-        app->sm = gbinder_servicemanager_new(BINDER_DEVICE);
-
-        if (argc > 1) {
+        if (!(driver = hidl_transport_find(transport ? transport : DEFAULT_TRANSPORT)))
+            ERR("Unknown transport %s", transport);
+        else if (argc > 1) {
             app->address = g_strdup(argv[1]);
+            app->transport = hidl_transport_new(driver, &app_transport_handler, app);
+        }
+
+        if (app->transport) {
+            if (flight_size > 0) {
+                app->flight_entries = g_new0(struct hidl_flight_entry, hidl_flight_entries(flight_size));
+                hidl_flight_init(&app->flight, app->flight_entries, flight_size);
+            }
+            if (flight_deadline > 0)
+                app->flight_deadline = flight_deadline * G_TIME_SPAN_MILLISECOND;
+
+            app->boot_id = ((guint64) g_random_int() << 32) | g_random_int();
+            app->optimistic = g_ptr_array_new_with_free_func((GDestroyNotify) g_pattern_spec_free);
+            if (optimistic_keys) {
+                app_set_optimistic_keys(app, optimistic_keys);
+                app->optimistic_fixed = TRUE;
+            }
+
+            app->loop = g_main_loop_new(NULL, TRUE);
             app->ret = RET_OK;
             dbus_init_delayed(app);
-            app_parse_all_slots(app);
+
+            if (slots) {
+                gint i;
+                for (i = 0; slots[i]; i++)
+                    app_add_slot(app, slots[i]);
+            } else {
+                app_sync_slots(app);
+                app_watch_slots(app);
+            }
             ok = TRUE;
         }
     } else {
@@ -614,6 +1156,9 @@ app_init(
         g_error_free(error);
     }
     g_option_context_free(options);
+    g_free(transport);
+    g_free(optimistic_keys);
+    g_strfreev(slots);
 
     if (!app->address)
         ERR("Address is not defined for %s", pname);
@@ -627,6 +1172,12 @@ app_deinit(
 {
     dbus_deinit(app);
     g_free(app->address);
+    g_free(app->flight_entries);
+    if (app->reload_source)
+        g_source_remove(app->reload_source);
+    g_slist_free_full(app->monitors, g_object_unref);
+    if (app->optimistic)
+        g_ptr_array_free(app->optimistic, TRUE);
 }
 
 int main(int argc, char* argv[])
@@ -637,12 +1188,13 @@ int main(int argc, char* argv[])
     app.ret = RET_INVARG;
 
     if (app_init(&app, argc, argv)) {
-        if (gbinder_servicemanager_wait(app.sm, -1))
+        /* Nothing to serve, don't bother with the servicemanager. */
+        if (app.ret != HELPER_EXIT_NO_SLOTS && hidl_transport_wait(app.transport))
             app_run(&app);
 
         g_main_loop_unref(app.loop);
-        g_slist_free_full(app.clients, am_client_free);
-        gbinder_servicemanager_unref(app.sm);
+        g_slist_free_full(app.clients, hidl_transport_slot_free);
+        hidl_transport_free(app.transport);
     }
 
     app_deinit(&app);
@@ -0,0 +1,271 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "hidl-journal.h"
+
+#define JOURNAL_MAGIC       (0x4c4e524aU) /* "JRNL" */
+#define JOURNAL_VERSION     (2)
+
+/* Records are kept in one of two equally sized halves following the
+ * header. Compaction writes into the inactive half and switches to it by
+ * changing active as the last step, so the previous records stay valid
+ * until the compacted ones are on disk. */
+struct journal_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t active;
+    /* Bytes of records in each half. Updated only after the record
+     * itself has been written. */
+    uint32_t used[2];
+};
+
+struct journal_record {
+    uint16_t key_len;
+    uint16_t value_len;
+    /* key and value bytes follow, not terminated */
+};
+
+struct hidl_journal {
+    char *path;
+    size_t size;
+    uint8_t *map;
+    struct journal_header *header;
+    pa_hashmap *state;
+};
+
+static size_t journal_capacity(hidl_journal *j) {
+    return (j->size - sizeof(struct journal_header)) / 2;
+}
+
+static uint8_t *journal_records(hidl_journal *j, unsigned half) {
+    return j->map + sizeof(struct journal_header) + half * journal_capacity(j);
+}
+
+static bool journal_sync(hidl_journal *j) {
+    if (msync(j->map, j->size, MS_SYNC) < 0) {
+        pa_log_warn("Failed to sync journal %s: %s", j->path, pa_cstrerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+static bool journal_append(hidl_journal *j, unsigned half, const char *key, const char *value) {
+    struct journal_record record;
+    size_t key_len, value_len, len;
+    uint8_t *p;
+
+    key_len = strlen(key);
+    value_len = strlen(value);
+
+    if (key_len > UINT16_MAX || value_len > UINT16_MAX)
+        return false;
+
+    len = sizeof(record) + key_len + value_len;
+    if (j->header->used[half] + len > journal_capacity(j))
+        return false;
+
+    record.key_len = (uint16_t) key_len;
+    record.value_len = (uint16_t) value_len;
+
+    p = journal_records(j, half) + j->header->used[half];
+    memcpy(p, &record, sizeof(record));
+    memcpy(p + sizeof(record), key, key_len);
+    memcpy(p + sizeof(record) + key_len, value, value_len);
+
+    j->header->used[half] += len;
+
+    return true;
+}
+
+/* Rewrite the current state into the inactive half and switch to it. If
+ * the compacted records can't be synced the active half is left as is. */
+static void journal_compact(hidl_journal *j) {
+    void *state = NULL;
+    const void *key;
+    const char *value;
+    unsigned half;
+
+    half = !j->header->active;
+    j->header->used[half] = 0;
+
+    while ((value = pa_hashmap_iterate(j->state, &state, &key))) {
+        if (!journal_append(j, half, key, value))
+            pa_log_warn("Journal %s full, dropping \"%s\".", j->path, (const char *) key);
+    }
+
+    if (!journal_sync(j))
+        return;
+
+    j->header->active = half;
+    journal_sync(j);
+
+    pa_log_debug("Journal %s compacted to %u bytes.", j->path, j->header->used[half]);
+}
+
+static void journal_reset(hidl_journal *j) {
+    memset(j->map, 0, j->size);
+    j->header->magic = JOURNAL_MAGIC;
+    j->header->version = JOURNAL_VERSION;
+    j->header->size = (uint32_t) j->size;
+    j->header->active = 0;
+    j->header->used[0] = j->header->used[1] = 0;
+}
+
+static bool journal_load(hidl_journal *j) {
+    const uint8_t *p, *end;
+    struct journal_record record;
+    char *key;
+
+    if (j->header->magic != JOURNAL_MAGIC ||
+        j->header->version != JOURNAL_VERSION ||
+        j->header->size != j->size ||
+        j->header->active > 1 ||
+        j->header->used[j->header->active] > journal_capacity(j))
+        return false;
+
+    p = journal_records(j, j->header->active);
+    end = p + j->header->used[j->header->active];
+
+    while (p + sizeof(record) <= end) {
+        memcpy(&record, p, sizeof(record));
+        p += sizeof(record);
+
+        if (p + record.key_len + record.value_len > end)
+            return false;
+
+        key = pa_xstrndup((const char *) p, record.key_len);
+        pa_hashmap_remove_and_free(j->state, key);
+        pa_hashmap_put(j->state, key, pa_xstrndup((const char *) p + record.key_len, record.value_len));
+        p += record.key_len + record.value_len;
+    }
+
+    return true;
+}
+
+hidl_journal *hidl_journal_open(const char *path, size_t size) {
+    hidl_journal *j;
+    struct stat st;
+    bool resize;
+    int fd;
+
+    pa_assert(path);
+    pa_assert(size > sizeof(struct journal_header) + 2 * sizeof(struct journal_record));
+
+    if ((fd = pa_open_cloexec(path, O_RDWR | O_CREAT, 0600)) < 0) {
+        pa_log("Failed to open journal %s: %s", path, pa_cstrerror(errno));
+        return NULL;
+    }
+
+    if (fstat(fd, &st) < 0) {
+        pa_log("Failed to stat journal %s: %s", path, pa_cstrerror(errno));
+        pa_close(fd);
+        return NULL;
+    }
+
+    if ((resize = ((size_t) st.st_size != size)) && ftruncate(fd, (off_t) size) < 0) {
+        pa_log("Failed to resize journal %s: %s", path, pa_cstrerror(errno));
+        pa_close(fd);
+        return NULL;
+    }
+
+    j = pa_xnew0(hidl_journal, 1);
+    j->path = pa_xstrdup(path);
+    j->size = size;
+    j->state = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                   pa_xfree, pa_xfree);
+
+    j->map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    pa_close(fd);
+
+    if (j->map == MAP_FAILED) {
+        pa_log("Failed to map journal %s: %s", path, pa_cstrerror(errno));
+        j->map = NULL;
+        hidl_journal_free(j);
+        return NULL;
+    }
+
+    j->header = (struct journal_header *) j->map;
+
+    if (resize || !journal_load(j)) {
+        if (!resize)
+            pa_log_warn("Journal %s is corrupted, starting empty.", path);
+        pa_hashmap_remove_all(j->state);
+        journal_reset(j);
+    } else
+        journal_compact(j);
+
+    pa_log_debug("Journal %s opened with %u keys.", path, pa_hashmap_size(j->state));
+
+    return j;
+}
+
+void hidl_journal_free(hidl_journal *j) {
+    pa_assert(j);
+
+    if (j->map)
+        munmap(j->map, j->size);
+
+    pa_hashmap_free(j->state);
+    pa_xfree(j->path);
+    pa_xfree(j);
+}
+
+void hidl_journal_update(hidl_journal *j, const char *key, const char *value) {
+    const char *old;
+
+    pa_assert(j);
+    pa_assert(key);
+    pa_assert(value);
+
+    if ((old = pa_hashmap_get(j->state, key)) && pa_streq(old, value))
+        return;
+
+    pa_hashmap_remove_and_free(j->state, key);
+    pa_hashmap_put(j->state, pa_xstrdup(key), pa_xstrdup(value));
+
+    if (!journal_append(j, j->header->active, key, value))
+        journal_compact(j);
+}
+
+pa_hashmap *hidl_journal_state(hidl_journal *j) {
+    pa_assert(j);
+
+    return j->state;
+}
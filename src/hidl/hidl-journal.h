@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidljournalfoo
+#define foohidljournalfoo
+
+#include <pulsecore/hashmap.h>
+
+/* Small mmap'ed journal of the last applied value per parameter key.
+ *
+ * Updates are appended as records, and the journal is compacted to
+ * contain only the latest value of each key when it runs out of space.
+ * Compaction writes into a second half of the file and switches over
+ * only once that has been synced, so a crash while compacting leaves the
+ * previous records in place. As the file lives in memory mapped pages,
+ * the state survives the process going away. */
+
+typedef struct hidl_journal hidl_journal;
+
+hidl_journal *hidl_journal_open(const char *path, size_t size);
+void hidl_journal_free(hidl_journal *j);
+
+/* Record value of key. Unchanged values are not written again. */
+void hidl_journal_update(hidl_journal *j, const char *key, const char *value);
+
+/* Current state, key (char *) -> value (char *). Owned by the journal. */
+pa_hashmap *hidl_journal_state(hidl_journal *j);
+
+#endif
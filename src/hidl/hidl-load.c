@@ -0,0 +1,444 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+/*
+ * D-Bus load generator for the passthrough interface. Connects to the
+ * PulseAudio D-Bus server the same way hidl-helper does and issues
+ * get_parameters and set_parameters calls from several connections in
+ * parallel, then reports throughput and latency percentiles.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "common.h"
+
+#define RET_OK                      (0)
+#define RET_ERR                     (1)
+#define RET_INVARG                  (2)
+
+#define DEFAULT_CONNECTIONS         (4)
+#define DEFAULT_REQUESTS            (10000)
+#define DEFAULT_SET_PERCENT         (10)
+#define DEFAULT_GET_KEYS            "bench_key_0"
+#define DEFAULT_SET_PAIRS_0         "bench_key_0=0"
+#define DEFAULT_SET_PAIRS_1         "bench_key_0=1"
+
+enum load_op {
+    LOAD_OP_GET,
+    LOAD_OP_SET,
+    LOAD_OP_COUNT
+};
+
+static const char* load_op_name[LOAD_OP_COUNT] = { "get", "set" };
+
+typedef struct load Load;
+
+typedef struct load_worker {
+    Load *load;
+    guint index;
+    GThread *thread;
+    GDBusConnection *dbus;
+    GRand *rand;
+    GArray *samples[LOAD_OP_COUNT];
+    guint errors[LOAD_OP_COUNT];
+} LoadWorker;
+
+struct load {
+    gchar *address;
+    gint connections;
+    gint requests;
+    gint duration;
+    gint set_percent;
+    gchar **get_keys;
+    gchar **set_pairs;
+    guint n_get_keys;
+    guint n_set_pairs;
+    gboolean verbose;
+
+    GMutex lock;
+    GCond cond;
+    guint ready;
+    gboolean go;
+    gint64 start;
+    gint64 end;
+
+    LoadWorker *workers;
+};
+
+static gboolean
+load_call(
+        LoadWorker *worker,
+        const gchar *method,
+        const gchar *args)
+{
+    GDBusMessage *msg;
+    GDBusMessage *reply;
+    GError *error = NULL;
+    gboolean ok = FALSE;
+
+    msg = g_dbus_message_new_method_call(NULL,
+                                         HIDL_PASSTHROUGH_PATH,
+                                         HIDL_PASSTHROUGH_IFACE,
+                                         method);
+    g_dbus_message_set_body(msg, g_variant_new("(s)", args));
+    reply = g_dbus_connection_send_message_with_reply_sync(worker->dbus,
+                                                           msg,
+                                                           G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                                           -1,
+                                                           NULL, /* out_serial */
+                                                           NULL, /* cancellable */
+                                                           &error);
+    if (!reply) {
+        if (worker->load->verbose)
+            g_printerr("[%u] %s(%s): %s\n", worker->index, method, args, error->message);
+        g_error_free(error);
+    } else {
+        if (g_dbus_message_get_message_type(reply) == G_DBUS_MESSAGE_TYPE_ERROR) {
+            if (worker->load->verbose)
+                g_printerr("[%u] %s(%s): %s\n", worker->index, method, args,
+                           g_dbus_message_get_error_name(reply));
+        } else
+            ok = TRUE;
+        g_object_unref(reply);
+    }
+
+    g_object_unref(msg);
+
+    return ok;
+}
+
+static gboolean
+load_worker_done(
+        LoadWorker *worker,
+        gint request)
+{
+    Load *load = worker->load;
+
+    if (load->duration > 0)
+        return g_get_monotonic_time() >= load->start + (gint64) load->duration * G_TIME_SPAN_SECOND;
+
+    return request >= load->requests;
+}
+
+static gpointer
+load_worker_run(
+        gpointer user_data)
+{
+    LoadWorker *worker = user_data;
+    Load *load = worker->load;
+    gint request;
+
+    g_mutex_lock(&load->lock);
+    load->ready++;
+    g_cond_broadcast(&load->cond);
+    while (!load->go)
+        g_cond_wait(&load->cond, &load->lock);
+    g_mutex_unlock(&load->lock);
+
+    for (request = 0; !load_worker_done(worker, request); request++) {
+        enum load_op op;
+        const gchar *method;
+        const gchar *args;
+        gint64 t;
+
+        if (g_rand_int_range(worker->rand, 0, 100) < load->set_percent) {
+            op = LOAD_OP_SET;
+            method = HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS;
+            args = load->set_pairs[g_rand_int_range(worker->rand, 0, load->n_set_pairs)];
+        } else {
+            op = LOAD_OP_GET;
+            method = HIDL_PASSTHROUGH_METHOD_GET_PARAMETERS;
+            args = load->get_keys[g_rand_int_range(worker->rand, 0, load->n_get_keys)];
+        }
+
+        t = g_get_monotonic_time();
+        if (load_call(worker, method, args)) {
+            t = g_get_monotonic_time() - t;
+            g_array_append_val(worker->samples[op], t);
+        } else
+            worker->errors[op]++;
+    }
+
+    return NULL;
+}
+
+static gboolean
+load_connect(
+        Load *load)
+{
+    gint i;
+
+    load->workers = g_new0(LoadWorker, load->connections);
+
+    for (i = 0; i < load->connections; i++) {
+        LoadWorker *worker = load->workers + i;
+        GError *error = NULL;
+        gint op;
+
+        worker->load = load;
+        worker->index = i;
+        worker->rand = g_rand_new_with_seed(i);
+        for (op = 0; op < LOAD_OP_COUNT; op++)
+            worker->samples[op] = g_array_sized_new(FALSE, FALSE, sizeof(gint64), 1024);
+
+        worker->dbus = g_dbus_connection_new_for_address_sync(load->address,
+                                                              G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                                              NULL,    /* observer */
+                                                              NULL,    /* cancellable */
+                                                              &error);
+        if (!worker->dbus) {
+            g_printerr("Could not connect to %s: %s\n", load->address, error->message);
+            g_error_free(error);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void
+load_run(
+        Load *load)
+{
+    gint i;
+
+    for (i = 0; i < load->connections; i++) {
+        LoadWorker *worker = load->workers + i;
+        gchar *name = g_strdup_printf("load-%d", i);
+
+        worker->thread = g_thread_new(name, load_worker_run, worker);
+        g_free(name);
+    }
+
+    /* Start all connections at once so the measured interval only
+     * contains time when every connection is issuing requests. */
+    g_mutex_lock(&load->lock);
+    while (load->ready < (guint) load->connections)
+        g_cond_wait(&load->cond, &load->lock);
+    load->start = g_get_monotonic_time();
+    load->go = TRUE;
+    g_cond_broadcast(&load->cond);
+    g_mutex_unlock(&load->lock);
+
+    for (i = 0; i < load->connections; i++) {
+        g_thread_join(load->workers[i].thread);
+        load->workers[i].thread = NULL;
+    }
+
+    load->end = g_get_monotonic_time();
+}
+
+static gint
+sample_cmp(
+        gconstpointer a,
+        gconstpointer b)
+{
+    gint64 sa = *(const gint64*) a;
+    gint64 sb = *(const gint64*) b;
+
+    return sa < sb ? -1 : sa > sb;
+}
+
+static gint64
+percentile(
+        GArray *samples,
+        guint permille)
+{
+    guint index = (guint) ((guint64) samples->len * permille / 1000);
+
+    if (index >= samples->len)
+        index = samples->len - 1;
+
+    return g_array_index(samples, gint64, index);
+}
+
+static void
+load_report(
+        Load *load)
+{
+    gdouble elapsed = (gdouble) (load->end - load->start) / G_TIME_SPAN_SECOND;
+    guint total = 0;
+    gint op;
+    gint i;
+
+    g_print("address: %s, connections: %d, set: %d%%\n\n",
+            load->address, load->connections, load->set_percent);
+    g_print("%-6s %10s %8s %12s %10s %10s %10s %10s %10s\n",
+            "op", "calls", "errors", "calls/s", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+
+    for (op = 0; op < LOAD_OP_COUNT; op++) {
+        GArray *samples = g_array_new(FALSE, FALSE, sizeof(gint64));
+        guint errors = 0;
+
+        for (i = 0; i < load->connections; i++) {
+            LoadWorker *worker = load->workers + i;
+
+            g_array_append_vals(samples, worker->samples[op]->data, worker->samples[op]->len);
+            errors += worker->errors[op];
+        }
+
+        total += samples->len;
+
+        if (samples->len) {
+            g_array_sort(samples, sample_cmp);
+            g_print("%-6s %10u %8u %12.0f %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT
+                    " %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT "\n",
+                    load_op_name[op],
+                    samples->len,
+                    errors,
+                    samples->len / elapsed,
+                    percentile(samples, 500),
+                    percentile(samples, 900),
+                    percentile(samples, 990),
+                    percentile(samples, 999),
+                    g_array_index(samples, gint64, samples->len - 1));
+        } else if (errors)
+            g_print("%-6s %10u %8u\n", load_op_name[op], 0, errors);
+
+        g_array_free(samples, TRUE);
+    }
+
+    g_print("\ntotal %u calls in %.2f s, %.0f calls/s\n", total, elapsed, total / elapsed);
+}
+
+static void
+load_deinit(
+        Load *load)
+{
+    gint i;
+    gint op;
+
+    if (load->workers) {
+        for (i = 0; i < load->connections; i++) {
+            LoadWorker *worker = load->workers + i;
+
+            if (worker->dbus)
+                g_object_unref(worker->dbus);
+            if (worker->rand)
+                g_rand_free(worker->rand);
+            for (op = 0; op < LOAD_OP_COUNT; op++)
+                if (worker->samples[op])
+                    g_array_free(worker->samples[op], TRUE);
+        }
+        g_free(load->workers);
+    }
+
+    g_mutex_clear(&load->lock);
+    g_cond_clear(&load->cond);
+    g_strfreev(load->get_keys);
+    g_strfreev(load->set_pairs);
+    g_free(load->address);
+}
+
+static gboolean
+load_init(
+        Load *load,
+        int argc,
+        char* argv[])
+{
+    gboolean ok = FALSE;
+    GError *error = NULL;
+    GOptionContext *options;
+
+    GOptionEntry entries[] = {
+        { "connections", 'c', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+          &load->connections, "Number of concurrent connections (default 4)", "N" },
+        { "requests", 'n', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+          &load->requests, "Requests per connection (default 10000)", "N" },
+        { "duration", 't', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+          &load->duration, "Run for given time instead of a request count", "SEC" },
+        { "get", 'g', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY,
+          &load->get_keys, "Keys for get_parameters, may be repeated", "KEYS" },
+        { "set", 's', G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY,
+          &load->set_pairs, "Key-value pairs for set_parameters, may be repeated", "PAIRS" },
+        { "set-percent", 'p', G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+          &load->set_percent, "Percentage of set_parameters calls (default 10)", "PERCENT" },
+        { "verbose", 'v', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+          &load->verbose, "Print failed calls", NULL },
+        { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+
+    load->connections = DEFAULT_CONNECTIONS;
+    load->requests = DEFAULT_REQUESTS;
+    load->set_percent = DEFAULT_SET_PERCENT;
+    g_mutex_init(&load->lock);
+    g_cond_init(&load->cond);
+
+    options = g_option_context_new("<PulseAudio DBus address>");
+    g_option_context_set_summary(options,
+        "Key mixes are picked at random for each request. Without --get or --set\n"
+        "\"" DEFAULT_GET_KEYS "\" is read and set alternately to 0 and 1.");
+    g_option_context_add_main_entries(options, entries, NULL);
+
+    if (!g_option_context_parse(options, &argc, &argv, &error)) {
+        g_printerr("Options: %s\n", error->message);
+        g_error_free(error);
+    } else if (argc != 2) {
+        g_printerr("Address is not defined\n");
+    } else if (load->connections < 1 || load->requests < 1 || load->duration < 0 ||
+               load->set_percent < 0 || load->set_percent > 100) {
+        g_printerr("Invalid arguments\n");
+    } else {
+        load->address = g_strdup(argv[1]);
+
+        if (!load->get_keys)
+            load->get_keys = g_strsplit(DEFAULT_GET_KEYS, ",", -1);
+        if (!load->set_pairs)
+            load->set_pairs = g_strsplit(DEFAULT_SET_PAIRS_0 "," DEFAULT_SET_PAIRS_1, ",", -1);
+
+        load->n_get_keys = g_strv_length(load->get_keys);
+        load->n_set_pairs = g_strv_length(load->set_pairs);
+        ok = TRUE;
+    }
+
+    g_option_context_free(options);
+
+    return ok;
+}
+
+int main(int argc, char* argv[])
+{
+    Load load;
+    int ret = RET_INVARG;
+
+    memset(&load, 0, sizeof(load));
+
+    if (load_init(&load, argc, argv)) {
+        ret = RET_ERR;
+        if (load_connect(&load)) {
+            load_run(&load);
+            load_report(&load);
+            ret = RET_OK;
+        }
+    }
+
+    load_deinit(&load);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
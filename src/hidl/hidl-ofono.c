@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "common.h"
+#include "hidl-ofono.h"
+
+#define LINE_MAX_LEN        (1024)
+#define WATCH_EVENTS        (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)
+
+struct hidl_ofono_watch {
+    pa_core *core;
+    int fd;
+    /* Watch of OFONO_RIL_SUBSCRIPTION_D, -1 while it doesn't exist. */
+    int dir_wd;
+    pa_io_event *io_event;
+    hidl_ofono_changed_cb_t cb;
+    void *userdata;
+};
+
+/* transport = binder:name=<slot> in any group. */
+static bool file_has_binder_slots(const char *filename) {
+    FILE *f;
+    char line[LINE_MAX_LEN];
+    char *key;
+    char *value;
+    char *name;
+    bool found = false;
+
+    if (!(f = pa_fopen_cloexec(filename, "r")))
+        return false;
+
+    while (!found && fgets(line, sizeof(line), f)) {
+        key = line + strspn(line, " \t");
+
+        if (*key == '#' || *key == '[' || !(value = strchr(key, '=')))
+            continue;
+
+        *value++ = '\0';
+
+        if (!pa_streq(pa_strip(key), "transport"))
+            continue;
+
+        value = pa_strip(value);
+        name = strrchr(value, '=');
+        found = pa_startswith(value, "binder:name") && name && name[1];
+    }
+
+    fclose(f);
+
+    return found;
+}
+
+bool hidl_ofono_has_binder_slots(void) {
+    DIR *dir;
+    struct dirent *de;
+    char *path;
+    bool found;
+
+    if ((found = file_has_binder_slots(OFONO_RIL_SUBSCRIPTION_CONF)))
+        return true;
+
+    if (!(dir = opendir(OFONO_RIL_SUBSCRIPTION_D)))
+        return false;
+
+    while (!found && (de = readdir(dir))) {
+        if (!pa_endswith(de->d_name, ".conf"))
+            continue;
+
+        path = pa_sprintf_malloc(OFONO_RIL_SUBSCRIPTION_D "/%s", de->d_name);
+        found = file_has_binder_slots(path);
+        pa_xfree(path);
+    }
+
+    closedir(dir);
+
+    return found;
+}
+
+static void watch_dir(hidl_ofono_watch *w) {
+    if ((w->dir_wd = inotify_add_watch(w->fd, OFONO_RIL_SUBSCRIPTION_D, WATCH_EVENTS)) < 0)
+        pa_log_debug("Can't watch " OFONO_RIL_SUBSCRIPTION_D ": %s", pa_cstrerror(errno));
+}
+
+static void io_cb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    hidl_ofono_watch *w = userdata;
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    const char *dir_name = strrchr(OFONO_RIL_SUBSCRIPTION_D, '/') + 1;
+    const struct inotify_event *event;
+    bool dir_created = false;
+    ssize_t r;
+    char *p;
+
+    pa_assert(w);
+
+    /* Only the subscription directory coming and going matters, the
+     * rest is re-checked as a whole. */
+    while ((r = read(w->fd, buffer, sizeof(buffer))) > 0) {
+        for (p = buffer; p < buffer + r; p += sizeof(struct inotify_event) + event->len) {
+            event = (const struct inotify_event *) p;
+
+            if (event->wd == w->dir_wd) {
+                if (event->mask & IN_IGNORED)
+                    w->dir_wd = -1;
+            } else if ((event->mask & (IN_CREATE | IN_MOVED_TO)) && (event->mask & IN_ISDIR) &&
+                       event->len && pa_streq(event->name, dir_name))
+                dir_created = true;
+        }
+    }
+
+    if (dir_created && w->dir_wd < 0)
+        watch_dir(w);
+
+    if (r < 0 && errno != EAGAIN) {
+        pa_log("Failed to read oFono configuration changes: %s", pa_cstrerror(errno));
+        a->io_free(w->io_event);
+        w->io_event = NULL;
+        return;
+    }
+
+    w->cb(w->userdata);
+}
+
+hidl_ofono_watch *hidl_ofono_watch_new(pa_core *core, hidl_ofono_changed_cb_t cb, void *userdata) {
+    hidl_ofono_watch *w;
+    char *dir;
+
+    pa_assert(core);
+    pa_assert(cb);
+
+    w = pa_xnew0(hidl_ofono_watch, 1);
+    w->core = core;
+    w->cb = cb;
+    w->userdata = userdata;
+
+    if ((w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0) {
+        pa_log("inotify_init1() failed: %s", pa_cstrerror(errno));
+        pa_xfree(w);
+        return NULL;
+    }
+
+    /* Watch the directory of the main file, it may not exist yet. */
+    dir = pa_parent_dir(OFONO_RIL_SUBSCRIPTION_CONF);
+    if (inotify_add_watch(w->fd, dir, WATCH_EVENTS) < 0)
+        pa_log_debug("Can't watch %s: %s", dir, pa_cstrerror(errno));
+    pa_xfree(dir);
+
+    /* Added later if it is created. */
+    watch_dir(w);
+
+    w->io_event = core->mainloop->io_new(core->mainloop, w->fd, PA_IO_EVENT_INPUT, io_cb, w);
+
+    return w;
+}
+
+void hidl_ofono_watch_free(hidl_ofono_watch *w) {
+    pa_assert(w);
+
+    if (w->io_event)
+        w->core->mainloop->io_free(w->io_event);
+
+    pa_close(w->fd);
+    pa_xfree(w);
+}
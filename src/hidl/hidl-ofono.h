@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlofonofoo
+#define foohidlofonofoo
+
+#include <stdbool.h>
+
+#include <pulsecore/core.h>
+
+/* oFono RIL configuration as seen by the module, to decide whether the
+ * helper has anything to serve. Configuration is parsed the same way as
+ * in the helper, without pulling in GLib. */
+
+typedef struct hidl_ofono_watch hidl_ofono_watch;
+
+typedef void (*hidl_ofono_changed_cb_t)(void *userdata);
+
+/* Returns true if any configured slot has a binder transport. */
+bool hidl_ofono_has_binder_slots(void);
+
+/* Calls cb from main loop when oFono RIL configuration files change.
+ * Returns NULL if configuration can't be watched. */
+hidl_ofono_watch *hidl_ofono_watch_new(pa_core *core, hidl_ofono_changed_cb_t cb, void *userdata);
+void hidl_ofono_watch_free(hidl_ofono_watch *w);
+
+#endif
@@ -0,0 +1,897 @@
+/*
+ * Copyright (C) 2019 Jolla Ltd.
+ *               2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * Contact: Juho Hämäläinen <juho.hamalainen@jolla.com>
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/strbuf.h>
+
+#include <droid/droid-util.h>
+
+#include "hidl-capture.h"
+#include "hidl-journal.h"
+#include "hidl-passthrough.h"
+#include "hidl-probes.h"
+
+#define DEFAULT_MODULE_ID   "primary"
+#define NEGATIVE_CACHE_MAX  (256)
+#define DEFAULT_NEGATIVE_TTL (60)
+#define ROUTING_KEY         "routing"
+#define JOURNAL_SIZE        (16 * 1024)
+#define DEFAULT_STATS_SIZE  (32)
+#define DEFAULT_STATE_SIZE  (256)
+#define DEFAULT_HAL_WARN_MS (0)
+
+struct hw_entry {
+    char *module_id;
+    pa_droid_hw_module *hw_module;
+};
+
+/* Keys matching pattern are handled by hw entry index. Keys not matching
+ * any route are handled by the first hw entry. */
+struct hw_route {
+    char *pattern;
+    unsigned index;
+};
+
+struct hidl_passthrough {
+    pa_core *core;
+
+    struct hw_entry *hw;
+    unsigned n_hw;
+    struct hw_route *routes;
+    unsigned n_routes;
+    bool attached;
+
+    char *probe_keys;
+
+    /* Keys the HAL didn't answer, key (char *) -> expiry time (pa_usec_t *).
+     * NULL if disabled. */
+    pa_hashmap *negative_cache;
+    pa_usec_t negative_ttl;
+    pa_hook_slot *sink_port_changed_slot;
+    pa_hook_slot *source_port_changed_slot;
+
+    /* Keys that are safe to restore, key is also the value. */
+    pa_hashmap *restore_keys;
+    hidl_journal *journal;
+
+    /* Per-key traffic statistics, NULL if disabled. */
+    hidl_stats *stats;
+    uint32_t stats_size;
+
+    /* Latest values of keys, NULL if disabled. */
+    hidl_state *state;
+
+    /* Traffic capture, NULL if disabled. */
+    hidl_capture *capture;
+
+    hidl_passthrough_timing timing;
+
+    /* HAL call watchdog, NULL if disabled. */
+    hidl_watchdog *watchdog;
+};
+
+static void negative_cache_clear(hidl_passthrough *p) {
+    pa_assert(p);
+
+    if (p->negative_cache && !pa_hashmap_isempty(p->negative_cache)) {
+        pa_log_debug("Forget %u unsupported keys.", pa_hashmap_size(p->negative_cache));
+        pa_hashmap_remove_all(p->negative_cache);
+    }
+}
+
+/* Setting a key or changing the route may make the HAL answer keys it
+ * didn't before, so forget the keys set and everything on route change. */
+static void negative_cache_forget(hidl_passthrough *p, const char *key_value_pairs) {
+    const char *state = NULL;
+    char *pair;
+    char *value;
+
+    pa_assert(p);
+    pa_assert(key_value_pairs);
+
+    if (!p->negative_cache || pa_hashmap_isempty(p->negative_cache))
+        return;
+
+    while ((pair = pa_split(key_value_pairs, ";", &state))) {
+        if ((value = strchr(pair, '=')))
+            *value = '\0';
+
+        if (pa_streq(pair, ROUTING_KEY))
+            negative_cache_clear(p);
+        else
+            pa_hashmap_remove_and_free(p->negative_cache, pair);
+
+        pa_xfree(pair);
+    }
+}
+
+static pa_hook_result_t port_changed_cb(pa_core *c, void *object, hidl_passthrough *p) {
+    pa_assert(p);
+
+    negative_cache_clear(p);
+
+    return PA_HOOK_OK;
+}
+
+/* Returns newly allocated string of keys that may be supported by the HAL,
+ * or NULL if all of the keys are known to be unsupported. Expired entries
+ * are dropped so that the keys are asked from the HAL again. */
+static char *negative_cache_filter(hidl_passthrough *p, const char *keys) {
+    pa_strbuf *buf;
+    const char *state = NULL;
+    pa_usec_t *expiry;
+    pa_usec_t now;
+    char *key;
+    bool filtered = false;
+
+    pa_assert(p);
+    pa_assert(keys);
+
+    if (!p->negative_cache || pa_hashmap_isempty(p->negative_cache))
+        return pa_xstrdup(keys);
+
+    buf = pa_strbuf_new();
+    now = pa_rtclock_now();
+
+    while ((key = pa_split(keys, ";", &state))) {
+        if ((expiry = pa_hashmap_get(p->negative_cache, key)) && *expiry <= now) {
+            pa_hashmap_remove_and_free(p->negative_cache, key);
+            expiry = NULL;
+        }
+
+        if (expiry)
+            filtered = true;
+        else
+            pa_strbuf_printf(buf, "%s%s", pa_strbuf_isempty(buf) ? "" : ";", key);
+        pa_xfree(key);
+    }
+
+    if (filtered && pa_strbuf_isempty(buf)) {
+        pa_strbuf_free(buf);
+        return NULL;
+    }
+
+    return pa_strbuf_to_string_free(buf);
+}
+
+static bool key_value_pairs_has_key(const char *key_value_pairs, const char *key) {
+    const char *state = NULL;
+    char *pair;
+    size_t len;
+    bool found = false;
+
+    len = strlen(key);
+
+    while (!found && (pair = pa_split(key_value_pairs, ";", &state))) {
+        if (pa_strneq(pair, key, len) && (pair[len] == '=' || pair[len] == '\0'))
+            found = true;
+        pa_xfree(pair);
+    }
+
+    return found;
+}
+
+/* Remember keys which were queried but are missing from the HAL reply. */
+static void negative_cache_update(hidl_passthrough *p, const char *keys, const char *key_value_pairs) {
+    const char *state = NULL;
+    pa_usec_t *expiry;
+    char *key;
+
+    pa_assert(p);
+    pa_assert(keys);
+
+    if (!p->negative_cache)
+        return;
+
+    while ((key = pa_split(keys, ";", &state))) {
+        if (pa_hashmap_size(p->negative_cache) < NEGATIVE_CACHE_MAX &&
+            (!key_value_pairs || !key_value_pairs_has_key(key_value_pairs, key))) {
+            pa_log_debug("Key \"%s\" is not supported by the HAL.", key);
+            expiry = pa_xnew(pa_usec_t, 1);
+            *expiry = pa_rtclock_now() + p->negative_ttl;
+            if (pa_hashmap_put(p->negative_cache, key, expiry) < 0) {
+                pa_xfree(expiry);
+                pa_xfree(key);
+            }
+        } else
+            pa_xfree(key);
+    }
+}
+
+/* Account semicolon separated keys or key-value pairs. */
+static void stats_update(hidl_passthrough *p, const char *list, bool write) {
+    const char *state = NULL;
+    char *item;
+    char *value;
+
+    while ((item = pa_split(list, ";", &state))) {
+        if ((value = strchr(item, '=')))
+            *value++ = '\0';
+
+        if (write)
+            hidl_stats_write(p->stats, item, value ? value : "");
+        else
+            hidl_stats_read(p->stats, item);
+
+        pa_xfree(item);
+    }
+}
+
+/* HAL time of a call is divided evenly between its keys. */
+static void stats_hal_time(hidl_passthrough *p, const char *list, pa_usec_t usec) {
+    const char *state = NULL;
+    const char *c;
+    char *item;
+    char *value;
+    unsigned n = 1;
+
+    for (c = list; (c = strchr(c, ';')); c++)
+        n++;
+
+    while ((item = pa_split(list, ";", &state))) {
+        if ((value = strchr(item, '=')))
+            *value = '\0';
+
+        hidl_stats_hal_time(p->stats, item, usec / n);
+        pa_xfree(item);
+    }
+}
+
+static unsigned route_key(hidl_passthrough *p, const char *key) {
+    unsigned i;
+
+    for (i = 0; i < p->n_routes; i++) {
+        if (fnmatch(p->routes[i].pattern, key, 0) == 0)
+            return p->routes[i].index;
+    }
+
+    return 0;
+}
+
+/* Split semicolon separated keys or key-value pairs to hw entries. Buffers
+ * are allocated only for hw entries which have items routed to them. */
+static void route_split(hidl_passthrough *p, const char *list, pa_strbuf **bufs) {
+    const char *state = NULL;
+    char *item;
+    char *value;
+    unsigned i;
+
+    while ((item = pa_split(list, ";", &state))) {
+        if ((value = strchr(item, '=')))
+            *value = '\0';
+
+        i = route_key(p, item);
+
+        if (value)
+            *value = '=';
+
+        if (!bufs[i])
+            bufs[i] = pa_strbuf_new();
+        else
+            pa_strbuf_puts(bufs[i], ";");
+
+        pa_strbuf_puts(bufs[i], item);
+        pa_xfree(item);
+    }
+}
+
+static void hal_time(hidl_passthrough *p, const char *list, pa_usec_t start, pa_usec_t end) {
+    if (p->stats)
+        stats_hal_time(p, list, end - start);
+
+    if (!p->timing.hal_begin)
+        p->timing.hal_begin = start;
+    p->timing.hal_end = end;
+    p->timing.hal_usec += end - start;
+}
+
+/* Returns newly allocated reply string, never NULL. */
+static char *hw_get_parameters(hidl_passthrough *p, struct hw_entry *hw, const char *keys) {
+    char *hal_reply;
+    char *key_value_pairs;
+    pa_usec_t start;
+    pa_usec_t end;
+
+    if (p->watchdog)
+        hidl_watchdog_begin(p->watchdog, keys);
+    pa_droid_hw_module_lock(hw->hw_module);
+    HIDL_PROBE1(lock_acquired, keys);
+    start = pa_rtclock_now();
+    HIDL_PROBE1(hal_entry, keys);
+    hal_reply = hw->hw_module->device->get_parameters(hw->hw_module->device, keys);
+    end = pa_rtclock_now();
+    if (p->watchdog)
+        hidl_watchdog_end(p->watchdog);
+    HIDL_PROBE3(hal_exit, keys, hal_reply ? 0 : -1, end - start);
+    hal_time(p, keys, start, end);
+    pa_droid_hw_module_unlock(hw->hw_module);
+    HIDL_PROBE2(lock_released, keys, pa_rtclock_now() - start);
+
+    if (*keys)
+        negative_cache_update(p, keys, hal_reply);
+
+    if (p->state && hal_reply)
+        hidl_state_update(p->state, hal_reply);
+
+    /* HAL reply is allocated with malloc() and needs to be released with free(). */
+    key_value_pairs = pa_xstrdup(hal_reply ? hal_reply : "");
+    free(hal_reply);
+
+    return key_value_pairs;
+}
+
+/* Returns newly allocated reply string, never NULL. */
+static char *get_parameters(hidl_passthrough *p, const char *keys) {
+    pa_strbuf **bufs;
+    pa_strbuf *merged;
+    char *query;
+    char *reply;
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(keys);
+
+    if (p->stats)
+        stats_update(p, keys, false);
+
+    if (!(query = negative_cache_filter(p, keys))) {
+        pa_log_debug("get_parameters(\"%s\"): all keys unsupported", keys);
+        return pa_xstrdup("");
+    }
+
+    /* An empty query has no keys to route, so like unrouted keys it goes
+     * to the first hw module. */
+    if (p->n_hw == 1 || !*query) {
+        reply = hw_get_parameters(p, &p->hw[0], query);
+        pa_xfree(query);
+        return reply;
+    }
+
+    bufs = pa_xnew0(pa_strbuf *, p->n_hw);
+    route_split(p, query, bufs);
+    pa_xfree(query);
+
+    merged = pa_strbuf_new();
+
+    for (i = 0; i < p->n_hw; i++) {
+        if (!bufs[i])
+            continue;
+
+        query = pa_strbuf_to_string_free(bufs[i]);
+        reply = hw_get_parameters(p, &p->hw[i], query);
+
+        if (*reply)
+            pa_strbuf_printf(merged, "%s%s", pa_strbuf_isempty(merged) ? "" : ";", reply);
+
+        pa_xfree(reply);
+        pa_xfree(query);
+    }
+
+    pa_xfree(bufs);
+
+    return pa_strbuf_to_string_free(merged);
+}
+
+char *hidl_passthrough_get(hidl_passthrough *p, const char *slot, const char *keys) {
+    pa_usec_t now;
+    char *reply;
+
+    pa_assert(p);
+
+    pa_zero(p->timing);
+
+    if (!p->capture)
+        return get_parameters(p, keys);
+
+    now = hidl_capture_now(p->capture);
+    reply = get_parameters(p, keys);
+    hidl_capture_write(p->capture, HIDL_CAPTURE_GET_PARAMETERS, now, slot, keys, p->timing.hal_usec, 0);
+
+    return reply;
+}
+
+static void negative_cache_probe(hidl_passthrough *p, const char *keys) {
+    pa_assert(p);
+    pa_assert(keys);
+
+    pa_xfree(get_parameters(p, keys));
+    pa_log_info("Probed keys, %u unsupported.", pa_hashmap_size(p->negative_cache));
+}
+
+static void journal_update(hidl_passthrough *p, const char *key_value_pairs) {
+    const char *state = NULL;
+    char *pair;
+    char *value;
+
+    pa_assert(p);
+    pa_assert(key_value_pairs);
+
+    if (!p->journal)
+        return;
+
+    while ((pair = pa_split(key_value_pairs, ";", &state))) {
+        if ((value = strchr(pair, '='))) {
+            *value++ = '\0';
+            if (pa_hashmap_get(p->restore_keys, pair))
+                hidl_journal_update(p->journal, pair, value);
+        }
+        pa_xfree(pair);
+    }
+}
+
+static int hw_set_parameters(hidl_passthrough *p, struct hw_entry *hw, const char *key_value_pairs) {
+    pa_usec_t start;
+    pa_usec_t end;
+    int ret;
+
+    if (p->watchdog)
+        hidl_watchdog_begin(p->watchdog, key_value_pairs);
+    pa_droid_hw_module_lock(hw->hw_module);
+    HIDL_PROBE1(lock_acquired, key_value_pairs);
+    start = pa_rtclock_now();
+    HIDL_PROBE1(hal_entry, key_value_pairs);
+    ret = hw->hw_module->device->set_parameters(hw->hw_module->device, key_value_pairs);
+    end = pa_rtclock_now();
+    if (p->watchdog)
+        hidl_watchdog_end(p->watchdog);
+    HIDL_PROBE3(hal_exit, key_value_pairs, ret, end - start);
+    hal_time(p, key_value_pairs, start, end);
+    pa_droid_hw_module_unlock(hw->hw_module);
+    HIDL_PROBE2(lock_released, key_value_pairs, pa_rtclock_now() - start);
+
+    if (ret == 0) {
+        journal_update(p, key_value_pairs);
+        if (p->state)
+            hidl_state_update(p->state, key_value_pairs);
+    }
+
+    return ret;
+}
+
+/* Returns 0 if all hw modules accepted their parameters, otherwise the
+ * first error. */
+static int set_parameters(hidl_passthrough *p, const char *key_value_pairs) {
+    pa_strbuf **bufs;
+    char *pairs;
+    unsigned i;
+    int ret = 0;
+    int r;
+
+    pa_assert(p);
+    pa_assert(key_value_pairs);
+
+    if (p->stats)
+        stats_update(p, key_value_pairs, true);
+
+    negative_cache_forget(p, key_value_pairs);
+
+    if (p->n_hw == 1 || !*key_value_pairs)
+        return hw_set_parameters(p, &p->hw[0], key_value_pairs);
+
+    bufs = pa_xnew0(pa_strbuf *, p->n_hw);
+    route_split(p, key_value_pairs, bufs);
+
+    for (i = 0; i < p->n_hw; i++) {
+        if (!bufs[i])
+            continue;
+
+        pairs = pa_strbuf_to_string_free(bufs[i]);
+        if ((r = hw_set_parameters(p, &p->hw[i], pairs)) != 0) {
+            pa_log_warn("set_parameters(\"%s\") failed for hw module %s: %d", pairs, p->hw[i].module_id, r);
+            if (ret == 0)
+                ret = r;
+        }
+        pa_xfree(pairs);
+    }
+
+    pa_xfree(bufs);
+
+    return ret;
+}
+
+int hidl_passthrough_set(hidl_passthrough *p, const char *slot, const char *key_value_pairs) {
+    pa_usec_t now;
+    int ret;
+
+    pa_assert(p);
+
+    pa_zero(p->timing);
+
+    if (!p->capture)
+        return set_parameters(p, key_value_pairs);
+
+    now = hidl_capture_now(p->capture);
+    ret = set_parameters(p, key_value_pairs);
+    hidl_capture_write(p->capture, HIDL_CAPTURE_SET_PARAMETERS, now, slot, key_value_pairs, p->timing.hal_usec, ret);
+
+    return ret;
+}
+
+/* Apply persisted state of allowed keys in one set_parameters() call. */
+static void journal_restore(hidl_passthrough *p) {
+    pa_strbuf *buf;
+    void *state = NULL;
+    const void *key;
+    const char *value;
+    char *key_value_pairs;
+    int ret;
+
+    pa_assert(p);
+
+    if (!p->journal)
+        return;
+
+    buf = pa_strbuf_new();
+
+    while ((value = pa_hashmap_iterate(hidl_journal_state(p->journal), &state, &key))) {
+        if (pa_hashmap_get(p->restore_keys, key))
+            pa_strbuf_printf(buf, "%s%s=%s", pa_strbuf_isempty(buf) ? "" : ";", (const char *) key, value);
+    }
+
+    if (pa_strbuf_isempty(buf)) {
+        pa_strbuf_free(buf);
+        return;
+    }
+
+    key_value_pairs = pa_strbuf_to_string_free(buf);
+
+    if ((ret = set_parameters(p, key_value_pairs)) != 0)
+        pa_log_warn("Restoring \"%s\" failed: %d", key_value_pairs, ret);
+    else
+        pa_log_info("Restored \"%s\"", key_value_pairs);
+
+    pa_xfree(key_value_pairs);
+}
+
+static int journal_init(hidl_passthrough *p, const char *module_id, const char *keys, const char *state_file) {
+    const char *state = NULL;
+    char *key;
+    char *fn;
+    char *path;
+
+    pa_assert(p);
+    pa_assert(module_id);
+    pa_assert(keys);
+
+    p->restore_keys = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                          pa_xfree, NULL);
+
+    while ((key = pa_split(keys, ";", &state))) {
+        if (pa_hashmap_put(p->restore_keys, key, key) < 0)
+            pa_xfree(key);
+    }
+
+    if (state_file)
+        path = pa_xstrdup(state_file);
+    else {
+        fn = pa_sprintf_malloc("droid-hidl-%s.state", module_id);
+        path = pa_runtime_path(fn);
+        pa_xfree(fn);
+    }
+
+    if (!path) {
+        pa_log("Couldn't determine state file path.");
+        return -1;
+    }
+
+    p->journal = hidl_journal_open(path, JOURNAL_SIZE);
+    pa_xfree(path);
+
+    return p->journal ? 0 : -1;
+}
+
+static int hw_init(hidl_passthrough *p, const char *module_ids, const char *key_routes) {
+    const char *state = NULL;
+    const char *pattern_state;
+    char *route;
+    char *pattern;
+    char *patterns;
+    char *id;
+    unsigned i;
+
+    pa_assert(p);
+    pa_assert(module_ids);
+
+    while ((id = pa_split(module_ids, ",", &state))) {
+        p->hw = pa_xrenew(struct hw_entry, p->hw, p->n_hw + 1);
+        p->hw[p->n_hw].module_id = id;
+        p->hw[p->n_hw].hw_module = NULL;
+        p->n_hw++;
+    }
+
+    if (p->n_hw == 0) {
+        pa_log("No hw modules defined.");
+        return -1;
+    }
+
+    if (!key_routes)
+        return 0;
+
+    state = NULL;
+    while ((route = pa_split(key_routes, ";", &state))) {
+        if (!(patterns = strchr(route, ':'))) {
+            pa_log("Invalid key route \"%s\".", route);
+            pa_xfree(route);
+            return -1;
+        }
+        *patterns++ = '\0';
+
+        for (i = 0; i < p->n_hw; i++) {
+            if (pa_streq(p->hw[i].module_id, route))
+                break;
+        }
+
+        if (i == p->n_hw) {
+            pa_log("Key route for unknown hw module %s.", route);
+            pa_xfree(route);
+            return -1;
+        }
+
+        pattern_state = NULL;
+        while ((pattern = pa_split(patterns, ",", &pattern_state))) {
+            p->routes = pa_xrenew(struct hw_route, p->routes, p->n_routes + 1);
+            p->routes[p->n_routes].pattern = pattern;
+            p->routes[p->n_routes].index = i;
+            p->n_routes++;
+        }
+
+        pa_xfree(route);
+    }
+
+    return 0;
+}
+
+static void hw_done(hidl_passthrough *p) {
+    unsigned i;
+
+    pa_assert(p);
+
+    for (i = 0; i < p->n_hw; i++) {
+        if (p->hw[i].hw_module)
+            pa_droid_hw_module_unref(p->hw[i].hw_module);
+        pa_xfree(p->hw[i].module_id);
+    }
+
+    for (i = 0; i < p->n_routes; i++)
+        pa_xfree(p->routes[i].pattern);
+
+    pa_xfree(p->hw);
+    pa_xfree(p->routes);
+    p->hw = NULL;
+    p->routes = NULL;
+    p->n_hw = p->n_routes = 0;
+}
+
+bool hidl_passthrough_attach(hidl_passthrough *p) {
+    struct hw_entry *hw;
+    unsigned i;
+    bool attached = true;
+    bool changed = false;
+
+    pa_assert(p);
+
+    if (p->attached)
+        return true;
+
+    for (i = 0; i < p->n_hw; i++) {
+        hw = &p->hw[i];
+
+        if (hw->hw_module)
+            continue;
+
+        if ((hw->hw_module = pa_droid_hw_module_get(p->core, NULL, hw->module_id))) {
+            pa_log_info("Attached to hw module %s.", hw->module_id);
+            changed = true;
+        } else
+            attached = false;
+    }
+
+    /* Whatever we knew about previous hw modules doesn't apply anymore. */
+    if (changed)
+        negative_cache_clear(p);
+
+    if (!attached)
+        return false;
+
+    p->attached = true;
+
+    if (p->probe_keys) {
+        if (p->negative_cache)
+            negative_cache_probe(p, p->probe_keys);
+        else
+            pa_log_warn("probe_keys ignored, negative_cache is not enabled.");
+    }
+
+    journal_restore(p);
+
+    return true;
+}
+
+hidl_passthrough *hidl_passthrough_new(pa_core *core, pa_modargs *ma) {
+    hidl_passthrough *p;
+    const char *restore;
+    const char *capture;
+    bool negative_cache = false;
+    uint32_t negative_ttl = DEFAULT_NEGATIVE_TTL;
+    uint32_t stats_size = DEFAULT_STATS_SIZE;
+    uint32_t state_size = DEFAULT_STATE_SIZE;
+    uint32_t hal_warn = DEFAULT_HAL_WARN_MS;
+
+    pa_assert(core);
+    pa_assert(ma);
+
+    p = pa_xnew0(hidl_passthrough, 1);
+    p->core = core;
+
+    if (hw_init(p, pa_modargs_get_value(ma, "module_ids", pa_modargs_get_value(ma, "module_id", DEFAULT_MODULE_ID)),
+                pa_modargs_get_value(ma, "key_routes", NULL)) < 0)
+        goto fail;
+
+    p->probe_keys = pa_xstrdup(pa_modargs_get_value(ma, "probe_keys", NULL));
+
+    if (pa_modargs_get_value_boolean(ma, "negative_cache", &negative_cache) < 0) {
+        pa_log("negative_cache is boolean argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "negative_cache_ttl", &negative_ttl) < 0 || negative_ttl == 0) {
+        pa_log("negative_cache_ttl is positive integer argument");
+        goto fail;
+    }
+
+    if (negative_cache) {
+        p->negative_cache = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                                pa_xfree, pa_xfree);
+        p->negative_ttl = negative_ttl * PA_USEC_PER_SEC;
+        p->sink_port_changed_slot = pa_hook_connect(&core->hooks[PA_CORE_HOOK_SINK_PORT_CHANGED], PA_HOOK_LATE,
+                                                    (pa_hook_cb_t) port_changed_cb, p);
+        p->source_port_changed_slot = pa_hook_connect(&core->hooks[PA_CORE_HOOK_SOURCE_PORT_CHANGED], PA_HOOK_LATE,
+                                                      (pa_hook_cb_t) port_changed_cb, p);
+    }
+
+    if (pa_modargs_get_value_u32(ma, "stats_size", &stats_size) < 0) {
+        pa_log("stats_size is unsigned integer argument");
+        goto fail;
+    }
+
+    if ((p->stats_size = stats_size) > 0)
+        p->stats = hidl_stats_new(stats_size);
+
+    if (pa_modargs_get_value_u32(ma, "state_size", &state_size) < 0) {
+        pa_log("state_size is unsigned integer argument");
+        goto fail;
+    }
+
+    if (state_size > 0)
+        p->state = hidl_state_new(state_size);
+
+    if ((restore = pa_modargs_get_value(ma, "restore_keys", NULL))) {
+        if (journal_init(p, p->hw[0].module_id, restore, pa_modargs_get_value(ma, "state_file", NULL)) < 0)
+            pa_log_warn("Parameter state is not persisted.");
+    }
+
+    if ((capture = pa_modargs_get_value(ma, "capture_file", NULL))) {
+        if (!(p->capture = hidl_capture_open(capture)))
+            pa_log_warn("Passthrough traffic is not captured.");
+    }
+
+    if (pa_modargs_get_value_u32(ma, "hal_warn", &hal_warn) < 0) {
+        pa_log("hal_warn is unsigned integer argument");
+        goto fail;
+    }
+
+    if (hal_warn > 0 && !(p->watchdog = hidl_watchdog_new(hal_warn * PA_USEC_PER_MSEC)))
+        pa_log_warn("HAL calls are not watched.");
+
+    return p;
+
+fail:
+    hidl_passthrough_free(p);
+    return NULL;
+}
+
+void hidl_passthrough_free(hidl_passthrough *p) {
+    pa_assert(p);
+
+    if (p->watchdog)
+        hidl_watchdog_free(p->watchdog);
+
+    hw_done(p);
+
+    if (p->sink_port_changed_slot)
+        pa_hook_slot_free(p->sink_port_changed_slot);
+
+    if (p->source_port_changed_slot)
+        pa_hook_slot_free(p->source_port_changed_slot);
+
+    if (p->negative_cache)
+        pa_hashmap_free(p->negative_cache);
+
+    if (p->journal)
+        hidl_journal_free(p->journal);
+
+    if (p->restore_keys)
+        pa_hashmap_free(p->restore_keys);
+
+    if (p->stats)
+        hidl_stats_free(p->stats);
+
+    if (p->state)
+        hidl_state_free(p->state);
+
+    if (p->capture)
+        hidl_capture_free(p->capture);
+
+    pa_xfree(p->probe_keys);
+    pa_xfree(p);
+}
+
+bool hidl_passthrough_attached(hidl_passthrough *p) {
+    pa_assert(p);
+
+    return p->attached;
+}
+
+const hidl_passthrough_timing *hidl_passthrough_last_timing(hidl_passthrough *p) {
+    pa_assert(p);
+
+    return &p->timing;
+}
+
+hidl_watchdog *hidl_passthrough_watchdog(hidl_passthrough *p) {
+    pa_assert(p);
+
+    return p->watchdog;
+}
+
+hidl_stats *hidl_passthrough_stats(hidl_passthrough *p) {
+    pa_assert(p);
+
+    return p->stats;
+}
+
+unsigned hidl_passthrough_stats_size(hidl_passthrough *p) {
+    pa_assert(p);
+
+    return p->stats_size;
+}
+
+hidl_state *hidl_passthrough_state(hidl_passthrough *p) {
+    pa_assert(p);
+
+    return p->state;
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlpassthroughfoo
+#define foohidlpassthroughfoo
+
+#include <pulsecore/core.h>
+#include <pulsecore/modargs.h>
+
+#include "hidl-state.h"
+#include "hidl-stats.h"
+#include "hidl-watchdog.h"
+
+/* Parameter passthrough to droid hw modules, without any D-Bus or helper
+ * handling. Configuration is read from module arguments. */
+
+typedef struct hidl_passthrough hidl_passthrough;
+
+/* HAL calls made for the latest get or set, in pa_rtclock_now() time. */
+typedef struct hidl_passthrough_timing {
+    pa_usec_t hal_begin;
+    pa_usec_t hal_end;
+    pa_usec_t hal_usec;
+} hidl_passthrough_timing;
+
+hidl_passthrough *hidl_passthrough_new(pa_core *core, pa_modargs *ma);
+void hidl_passthrough_free(hidl_passthrough *p);
+
+/* Try to attach to hw modules which are not attached yet. Returns true
+ * once all hw modules are attached. */
+bool hidl_passthrough_attach(hidl_passthrough *p);
+bool hidl_passthrough_attached(hidl_passthrough *p);
+
+/* slot is the modem slot the request came from, NULL if not known. */
+
+/* Returns newly allocated key-value pairs, never NULL. */
+char *hidl_passthrough_get(hidl_passthrough *p, const char *slot, const char *keys);
+/* Returns 0 on success, otherwise the HAL error. */
+int hidl_passthrough_set(hidl_passthrough *p, const char *slot, const char *key_value_pairs);
+
+const hidl_passthrough_timing *hidl_passthrough_last_timing(hidl_passthrough *p);
+
+/* NULL if HAL watchdog is disabled. */
+hidl_watchdog *hidl_passthrough_watchdog(hidl_passthrough *p);
+
+/* NULL if statistics are disabled. */
+hidl_stats *hidl_passthrough_stats(hidl_passthrough *p);
+unsigned hidl_passthrough_stats_size(hidl_passthrough *p);
+
+/* NULL if parameter state is not tracked. */
+hidl_state *hidl_passthrough_state(hidl_passthrough *p);
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlprobesfoo
+#define foohidlprobesfoo
+
+/* Static USDT tracepoints of the passthrough path for perf and bpftrace,
+ * shared by the module and the helper. All probes are in provider "hidl",
+ * for example
+ *
+ *   bpftrace -e 'usdt:/usr/libexec/pulse/hidl-helper:hidl:binder_exit
+ *                { @[str(arg1)] = hist(arg4); }'
+ *
+ * A disabled USDT probe is a single nop. Configure with --disable-usdt to
+ * compile them out entirely, then the arguments aren't evaluated either.
+ *
+ * Module:
+ *   handler_entry(set, payload)
+ *   handler_exit(set, payload, result, usec)         usec since entry
+ *   lock_acquired(payload)
+ *   hal_entry(payload)
+ *   hal_exit(payload, result, usec)                  usec of HAL call
+ *   lock_released(payload, usec)                     usec lock was held
+ *
+ * Helper:
+ *   binder_entry(slot, set, payload)
+ *   binder_exit(slot, set, payload, result, usec)    usec since entry
+ *   dbus_send(method, id)
+ *   dbus_reply(method, id, result, usec)             usec of D-Bus call
+ *
+ * set is 1 for setParameters, 0 for getParameters. For getParameters the
+ * result is 0 on success. */
+
+#ifdef HIDL_USDT
+
+#include <sys/sdt.h>
+
+#define HIDL_PROBE1(name, a)                    DTRACE_PROBE1(hidl, name, a)
+#define HIDL_PROBE2(name, a, b)                 DTRACE_PROBE2(hidl, name, a, b)
+#define HIDL_PROBE3(name, a, b, c)              DTRACE_PROBE3(hidl, name, a, b, c)
+#define HIDL_PROBE4(name, a, b, c, d)           DTRACE_PROBE4(hidl, name, a, b, c, d)
+#define HIDL_PROBE5(name, a, b, c, d, e)        DTRACE_PROBE5(hidl, name, a, b, c, d, e)
+
+#else
+
+#define HIDL_PROBE1(name, a)                    do { } while (0)
+#define HIDL_PROBE2(name, a, b)                 do { } while (0)
+#define HIDL_PROBE3(name, a, b, c)              do { } while (0)
+#define HIDL_PROBE4(name, a, b, c, d)           do { } while (0)
+#define HIDL_PROBE5(name, a, b, c, d, e)        do { } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,379 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+/*
+ * Replays traffic captured with the capture_file argument of
+ * module-droid-hidl through the D-Bus interface of a running PulseAudio,
+ * either with the original timing or as fast as possible.
+ */
+
+#include <string.h>
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "common.h"
+#include "hidl-capture.h"
+
+#define RET_OK                      (0)
+#define RET_ERR                     (1)
+#define RET_INVARG                  (2)
+
+typedef struct replay_request {
+    gint64 time_usec;
+    gint64 hal_usec;
+    gint result;
+    guint8 type;
+    gchar *slot;
+    gchar *payload;
+} ReplayRequest;
+
+typedef struct replay {
+    gchar *path;
+    gchar *address;
+    gboolean fast;
+    gdouble speed;
+    gboolean verbose;
+    GDBusConnection *dbus;
+    GArray *requests;
+
+    GArray *latency;
+    GArray *hal;
+    guint errors;
+    guint mismatches;
+    gint64 max_late;
+    gint64 elapsed;
+} Replay;
+
+static void
+replay_request_clear(
+        gpointer data)
+{
+    ReplayRequest *r = data;
+
+    g_free(r->slot);
+    g_free(r->payload);
+}
+
+static gboolean
+replay_load(
+        Replay *replay)
+{
+    struct hidl_capture_header header;
+    struct hidl_capture_record record;
+    GError *error = NULL;
+    gchar *data;
+    gsize len;
+    gsize pos;
+
+    if (!g_file_get_contents(replay->path, &data, &len, &error)) {
+        g_printerr("%s\n", error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    if (len < sizeof(header)) {
+        g_printerr("%s: not a capture file\n", replay->path);
+        g_free(data);
+        return FALSE;
+    }
+
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != HIDL_CAPTURE_MAGIC || header.version != HIDL_CAPTURE_VERSION) {
+        g_printerr("%s: not a capture file or unsupported version\n", replay->path);
+        g_free(data);
+        return FALSE;
+    }
+
+    for (pos = sizeof(header); pos + sizeof(record) <= len; ) {
+        ReplayRequest r;
+
+        memcpy(&record, data + pos, sizeof(record));
+        pos += sizeof(record);
+
+        /* Capture cut short while writing the last record. */
+        if (pos + record.slot_len + record.payload_len > len)
+            break;
+
+        r.time_usec = record.time_usec;
+        r.hal_usec = record.hal_usec;
+        r.result = record.result;
+        r.type = record.type;
+        r.slot = g_strndup(data + pos, record.slot_len);
+        pos += record.slot_len;
+        r.payload = g_strndup(data + pos, record.payload_len);
+        pos += record.payload_len;
+
+        g_array_append_val(replay->requests, r);
+    }
+
+    g_free(data);
+
+    return TRUE;
+}
+
+static gboolean
+replay_call(
+        Replay *replay,
+        const ReplayRequest *r)
+{
+    GDBusMessage *msg;
+    GDBusMessage *reply;
+    GError *error = NULL;
+    const gchar *method;
+    gboolean ok = FALSE;
+
+    method = r->type == HIDL_CAPTURE_SET_PARAMETERS ? HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS
+                                                    : HIDL_PASSTHROUGH_METHOD_GET_PARAMETERS;
+
+    msg = g_dbus_message_new_method_call(NULL,
+                                         HIDL_PASSTHROUGH_PATH,
+                                         HIDL_PASSTHROUGH_IFACE,
+                                         method);
+    g_dbus_message_set_body(msg, g_variant_new("(s)", r->payload));
+    reply = g_dbus_connection_send_message_with_reply_sync(replay->dbus,
+                                                           msg,
+                                                           G_DBUS_SEND_MESSAGE_FLAGS_NONE,
+                                                           -1,
+                                                           NULL, /* out_serial */
+                                                           NULL, /* cancellable */
+                                                           &error);
+    if (!reply) {
+        g_printerr("%s(%s): %s\n", method, r->payload, error->message);
+        g_error_free(error);
+        replay->errors++;
+    } else {
+        ok = g_dbus_message_get_message_type(reply) != G_DBUS_MESSAGE_TYPE_ERROR;
+
+        /* Only set_parameters results are known, failure of the
+         * original call was captured as a non-zero result. */
+        if (r->type == HIDL_CAPTURE_SET_PARAMETERS && ok != (r->result == 0)) {
+            if (replay->verbose)
+                g_printerr("%s(%s): %s, captured result %d\n", method, r->payload,
+                           ok ? "succeeded" : "failed", r->result);
+            replay->mismatches++;
+        }
+        g_object_unref(reply);
+    }
+
+    g_object_unref(msg);
+
+    return ok;
+}
+
+static void
+replay_run(
+        Replay *replay)
+{
+    gint64 start;
+    guint i;
+
+    start = g_get_monotonic_time();
+
+    for (i = 0; i < replay->requests->len; i++) {
+        const ReplayRequest *r = &g_array_index(replay->requests, ReplayRequest, i);
+        gint64 t;
+
+        if (!replay->fast) {
+            gint64 target = start + (gint64) (r->time_usec / replay->speed);
+
+            t = g_get_monotonic_time();
+            if (t < target)
+                g_usleep(target - t);
+            else if (t - target > replay->max_late)
+                replay->max_late = t - target;
+        }
+
+        t = g_get_monotonic_time();
+        replay_call(replay, r);
+        t = g_get_monotonic_time() - t;
+
+        g_array_append_val(replay->latency, t);
+        g_array_append_val(replay->hal, r->hal_usec);
+    }
+
+    replay->elapsed = g_get_monotonic_time() - start;
+}
+
+static gint
+sample_cmp(
+        gconstpointer a,
+        gconstpointer b)
+{
+    gint64 sa = *(const gint64*) a;
+    gint64 sb = *(const gint64*) b;
+
+    return sa < sb ? -1 : sa > sb;
+}
+
+static gint64
+percentile(
+        GArray *samples,
+        guint percent)
+{
+    guint index = samples->len * percent / 100;
+
+    if (index >= samples->len)
+        index = samples->len - 1;
+
+    return g_array_index(samples, gint64, index);
+}
+
+static void
+replay_report_samples(
+        const gchar *name,
+        GArray *samples)
+{
+    g_array_sort(samples, sample_cmp);
+    g_print("%-16s %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT " %10" G_GINT64_FORMAT "\n",
+            name,
+            percentile(samples, 50),
+            percentile(samples, 99),
+            g_array_index(samples, gint64, samples->len - 1));
+}
+
+static void
+replay_report(
+        Replay *replay)
+{
+    g_print("%u requests in %.2f s, %u errors, %u result mismatches",
+            replay->requests->len,
+            (gdouble) replay->elapsed / G_TIME_SPAN_SECOND,
+            replay->errors,
+            replay->mismatches);
+    if (!replay->fast)
+        g_print(", max %" G_GINT64_FORMAT " us behind schedule", replay->max_late);
+    g_print("\n");
+
+    if (!replay->latency->len)
+        return;
+
+    g_print("\n%-16s %10s %10s %10s\n", "", "p50 us", "p99 us", "max us");
+    replay_report_samples("replayed call", replay->latency);
+    replay_report_samples("captured HAL", replay->hal);
+}
+
+static gboolean
+replay_init(
+        Replay *replay,
+        int argc,
+        char* argv[])
+{
+    gboolean ok = FALSE;
+    GError *error = NULL;
+    GOptionContext *options;
+
+    GOptionEntry entries[] = {
+        { "fast", 'f', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+          &replay->fast, "Replay as fast as possible instead of original timing", NULL },
+        { "speed", 's', G_OPTION_FLAG_NONE, G_OPTION_ARG_DOUBLE,
+          &replay->speed, "Speed up original timing by factor (default 1.0)", "FACTOR" },
+        { "verbose", 'v', G_OPTION_FLAG_NONE, G_OPTION_ARG_NONE,
+          &replay->verbose, "Print result mismatches", NULL },
+        { NULL, 0, 0, 0, NULL, NULL, NULL }
+    };
+
+    replay->speed = 1.0;
+    replay->requests = g_array_new(FALSE, FALSE, sizeof(ReplayRequest));
+    g_array_set_clear_func(replay->requests, replay_request_clear);
+    replay->latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+    replay->hal = g_array_new(FALSE, FALSE, sizeof(gint64));
+
+    options = g_option_context_new("<capture file> <PulseAudio DBus address>");
+    g_option_context_add_main_entries(options, entries, NULL);
+
+    if (!g_option_context_parse(options, &argc, &argv, &error)) {
+        g_printerr("Options: %s\n", error->message);
+        g_error_free(error);
+    } else if (argc != 3) {
+        g_printerr("Capture file and address are required\n");
+    } else if (replay->speed <= 0) {
+        g_printerr("Invalid speed\n");
+    } else {
+        replay->path = g_strdup(argv[1]);
+        replay->address = g_strdup(argv[2]);
+        ok = TRUE;
+    }
+
+    g_option_context_free(options);
+
+    return ok;
+}
+
+static gboolean
+replay_connect(
+        Replay *replay)
+{
+    GError *error = NULL;
+
+    replay->dbus = g_dbus_connection_new_for_address_sync(replay->address,
+                                                          G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT,
+                                                          NULL,    /* observer */
+                                                          NULL,    /* cancellable */
+                                                          &error);
+    if (!replay->dbus) {
+        g_printerr("Could not connect to %s: %s\n", replay->address, error->message);
+        g_error_free(error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static void
+replay_deinit(
+        Replay *replay)
+{
+    if (replay->dbus)
+        g_object_unref(replay->dbus);
+
+    g_array_free(replay->requests, TRUE);
+    g_array_free(replay->latency, TRUE);
+    g_array_free(replay->hal, TRUE);
+    g_free(replay->path);
+    g_free(replay->address);
+}
+
+int main(int argc, char* argv[])
+{
+    Replay replay;
+    int ret = RET_INVARG;
+
+    memset(&replay, 0, sizeof(replay));
+
+    if (replay_init(&replay, argc, argv)) {
+        ret = RET_ERR;
+        if (replay_load(&replay) && replay_connect(&replay)) {
+            replay_run(&replay);
+            replay_report(&replay);
+            ret = RET_OK;
+        }
+    }
+
+    replay_deinit(&replay);
+    return ret;
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "hidl-sched.h"
+
+#define CALLER_HELPER       "@helper"
+
+struct sched_item {
+    void *request;
+    enum hidl_sched_class class;
+    pa_usec_t queued;
+    struct sched_item *next;
+};
+
+/* Requests of one owner in push order. */
+struct sched_queue {
+    const void *owner;
+    struct sched_item *head;
+    struct sched_item *tail;
+};
+
+struct sched_rule {
+    enum hidl_sched_class class;
+    char *pattern;
+};
+
+struct hidl_sched {
+    pa_core *core;
+    pa_defer_event *defer_event;
+    pa_usec_t aging;
+
+    hidl_sched_run_cb_t run_cb;
+    pa_free_cb_t free_cb;
+    void *userdata;
+
+    struct sched_rule *rules;
+    unsigned n_rules;
+
+    /* owner -> struct sched_queue, while the owner has queued requests. */
+    pa_hashmap *queues;
+    hidl_sched_stats stats[HIDL_SCHED_CLASSES];
+};
+
+static const char *const class_names[HIDL_SCHED_CLASSES] = {
+    [HIDL_SCHED_HIGH] = "high",
+    [HIDL_SCHED_NORMAL] = "normal",
+    [HIDL_SCHED_LOW] = "low"
+};
+
+static int class_from_string(const char *name, enum hidl_sched_class *class) {
+    unsigned i;
+
+    for (i = 0; i < HIDL_SCHED_CLASSES; i++) {
+        if (pa_streq(name, class_names[i])) {
+            *class = i;
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int parse_config(hidl_sched *s, const char *config) {
+    const char *state = NULL;
+    const char *pattern_state;
+    char *entry;
+    char *patterns;
+    char *pattern;
+    enum hidl_sched_class class;
+
+    while ((entry = pa_split(config, ";", &state))) {
+        if (!(patterns = strchr(entry, ':'))) {
+            pa_log("Invalid priority entry \"%s\".", entry);
+            pa_xfree(entry);
+            return -1;
+        }
+        *patterns++ = '\0';
+
+        if (class_from_string(entry, &class) < 0) {
+            pa_log("Unknown priority class \"%s\".", entry);
+            pa_xfree(entry);
+            return -1;
+        }
+
+        pattern_state = NULL;
+        while ((pattern = pa_split(patterns, ",", &pattern_state))) {
+            s->rules = pa_xrenew(struct sched_rule, s->rules, s->n_rules + 1);
+            s->rules[s->n_rules].class = class;
+            s->rules[s->n_rules].pattern = pattern;
+            s->n_rules++;
+        }
+
+        pa_xfree(entry);
+    }
+
+    return 0;
+}
+
+static enum hidl_sched_class classify_name(hidl_sched *s, const char *name, enum hidl_sched_class class) {
+    unsigned i;
+
+    for (i = 0; i < s->n_rules; i++) {
+        if (s->rules[i].class < class && fnmatch(s->rules[i].pattern, name, 0) == 0)
+            class = s->rules[i].class;
+    }
+
+    return class;
+}
+
+enum hidl_sched_class hidl_sched_classify(hidl_sched *s, const char *payload, bool helper) {
+    enum hidl_sched_class class = HIDL_SCHED_CLASSES;
+    const char *state = NULL;
+    char *key;
+    char *value;
+
+    pa_assert(s);
+    pa_assert(payload);
+
+    if (helper)
+        class = classify_name(s, CALLER_HELPER, class);
+
+    while (class > HIDL_SCHED_HIGH && (key = pa_split(payload, ";", &state))) {
+        if ((value = strchr(key, '=')))
+            *value = '\0';
+        class = classify_name(s, key, class);
+        pa_xfree(key);
+    }
+
+    return class == HIDL_SCHED_CLASSES ? HIDL_SCHED_NORMAL : class;
+}
+
+/* Aged requests run first, oldest first, the rest by class and then
+ * age. */
+static bool runs_before(const struct sched_item *a, bool a_aged, const struct sched_item *b, bool b_aged) {
+    if (a_aged != b_aged)
+        return a_aged;
+
+    if (!a_aged && a->class != b->class)
+        return a->class < b->class;
+
+    return a->queued < b->queued;
+}
+
+/* Picks among the oldest request of each owner. Returns NULL if nothing
+ * is queued. */
+static struct sched_queue *pick(hidl_sched *s, pa_usec_t now) {
+    struct sched_queue *best = NULL;
+    struct sched_queue *q;
+    bool best_aged = false;
+    bool aged;
+    void *state;
+
+    PA_HASHMAP_FOREACH(q, s->queues, state) {
+        aged = q->head->queued + s->aging <= now;
+
+        if (!best || runs_before(q->head, aged, best->head, best_aged)) {
+            best = q;
+            best_aged = aged;
+        }
+    }
+
+    return best;
+}
+
+static void queue_free(struct sched_queue *q) {
+    pa_xfree(q);
+}
+
+static void defer_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    hidl_sched *s = userdata;
+    struct sched_queue *q;
+    struct sched_item *item;
+    hidl_sched_stats *stats;
+    pa_usec_t now;
+    pa_usec_t wait;
+
+    pa_assert(s);
+
+    now = pa_rtclock_now();
+
+    if (!(q = pick(s, now))) {
+        s->core->mainloop->defer_enable(s->defer_event, 0);
+        return;
+    }
+
+    item = q->head;
+    if (!(q->head = item->next))
+        pa_hashmap_remove_and_free(s->queues, q->owner);
+
+    wait = now - item->queued;
+    stats = &s->stats[item->class];
+    stats->count++;
+    stats->wait_usec += wait;
+    if (wait > stats->max_wait_usec)
+        stats->max_wait_usec = wait;
+
+    s->run_cb(item->request, s->userdata);
+    pa_xfree(item);
+}
+
+hidl_sched *hidl_sched_new(pa_core *core, const char *config, pa_usec_t aging,
+                           hidl_sched_run_cb_t run_cb, pa_free_cb_t free_cb, void *userdata) {
+    hidl_sched *s;
+
+    pa_assert(core);
+    pa_assert(config);
+    pa_assert(run_cb);
+
+    s = pa_xnew0(hidl_sched, 1);
+    s->core = core;
+    s->aging = aging;
+    s->run_cb = run_cb;
+    s->free_cb = free_cb;
+    s->userdata = userdata;
+    s->queues = pa_hashmap_new_full(pa_idxset_trivial_hash_func, pa_idxset_trivial_compare_func,
+                                    NULL, (pa_free_cb_t) queue_free);
+
+    if (parse_config(s, config) < 0) {
+        hidl_sched_free(s);
+        return NULL;
+    }
+
+    s->defer_event = core->mainloop->defer_new(core->mainloop, defer_cb, s);
+    core->mainloop->defer_enable(s->defer_event, 0);
+
+    return s;
+}
+
+void hidl_sched_free(hidl_sched *s) {
+    struct sched_queue *q;
+    struct sched_item *item;
+    unsigned i;
+
+    pa_assert(s);
+
+    if (s->defer_event)
+        s->core->mainloop->defer_free(s->defer_event);
+
+    while ((q = pa_hashmap_steal_first(s->queues))) {
+        while ((item = q->head)) {
+            q->head = item->next;
+            if (s->free_cb)
+                s->free_cb(item->request);
+            pa_xfree(item);
+        }
+        queue_free(q);
+    }
+    pa_hashmap_free(s->queues);
+
+    for (i = 0; i < s->n_rules; i++)
+        pa_xfree(s->rules[i].pattern);
+    pa_xfree(s->rules);
+    pa_xfree(s);
+}
+
+void hidl_sched_push(hidl_sched *s, const void *owner, enum hidl_sched_class class, void *request) {
+    struct sched_queue *q;
+    struct sched_item *item;
+
+    pa_assert(s);
+    pa_assert(class < HIDL_SCHED_CLASSES);
+
+    item = pa_xnew0(struct sched_item, 1);
+    item->request = request;
+    item->class = class;
+    item->queued = pa_rtclock_now();
+
+    if (!(q = pa_hashmap_get(s->queues, owner))) {
+        q = pa_xnew0(struct sched_queue, 1);
+        q->owner = owner;
+        pa_hashmap_put(s->queues, (void *) q->owner, q);
+    }
+
+    if (q->tail)
+        q->tail->next = item;
+    else
+        q->head = item;
+    q->tail = item;
+
+    s->core->mainloop->defer_enable(s->defer_event, 1);
+}
+
+const char *hidl_sched_class_to_string(enum hidl_sched_class class) {
+    pa_assert(class < HIDL_SCHED_CLASSES);
+
+    return class_names[class];
+}
+
+const hidl_sched_stats *hidl_sched_get_stats(hidl_sched *s, enum hidl_sched_class class) {
+    pa_assert(s);
+    pa_assert(class < HIDL_SCHED_CLASSES);
+
+    return &s->stats[class];
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlschedfoo
+#define foohidlschedfoo
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pulsecore/core.h>
+
+/* Priority scheduler in front of the HAL.
+ *
+ * Requests are classified by their keys and caller into priority classes
+ * and run one per main loop iteration. Requests of one owner (a D-Bus
+ * connection) run in the order they were pushed; between owners the
+ * oldest request of each competes, highest class first, so that a
+ * request may overtake queued ones of a lower class from other owners.
+ * A request that has waited longer than the aging limit runs before
+ * higher classes, so lower classes don't starve.
+ *
+ * Configuration is a list of <class>:<pattern>[,<pattern>...] separated
+ * by ';', where class is high, normal or low and pattern is a key glob
+ * pattern or @helper for requests made by the helper. A request gets the
+ * highest class any of its keys or its caller matches, normal if none. */
+
+enum hidl_sched_class {
+    HIDL_SCHED_HIGH,
+    HIDL_SCHED_NORMAL,
+    HIDL_SCHED_LOW,
+    HIDL_SCHED_CLASSES
+};
+
+typedef struct hidl_sched hidl_sched;
+
+typedef struct hidl_sched_stats {
+    uint64_t count;
+    pa_usec_t wait_usec;
+    pa_usec_t max_wait_usec;
+} hidl_sched_stats;
+
+/* Run a queued request, called from main loop. */
+typedef void (*hidl_sched_run_cb_t)(void *request, void *userdata);
+
+/* Returns NULL if config is invalid. Requests still queued when freed are
+ * passed to free_cb. */
+hidl_sched *hidl_sched_new(pa_core *core, const char *config, pa_usec_t aging,
+                           hidl_sched_run_cb_t run_cb, pa_free_cb_t free_cb, void *userdata);
+void hidl_sched_free(hidl_sched *s);
+
+enum hidl_sched_class hidl_sched_classify(hidl_sched *s, const char *payload, bool helper);
+void hidl_sched_push(hidl_sched *s, const void *owner, enum hidl_sched_class class, void *request);
+
+const char *hidl_sched_class_to_string(enum hidl_sched_class class);
+const hidl_sched_stats *hidl_sched_get_stats(hidl_sched *s, enum hidl_sched_class class);
+
+#endif
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+
+#include "hidl-state.h"
+
+struct hidl_state {
+    unsigned max_keys;
+    unsigned n_entries;
+    unsigned size;
+    /* sorted by key */
+    hidl_state_entry *entries;
+};
+
+hidl_state *hidl_state_new(unsigned max_keys) {
+    hidl_state *s;
+
+    pa_assert(max_keys > 0);
+
+    s = pa_xnew0(hidl_state, 1);
+    s->max_keys = max_keys;
+
+    return s;
+}
+
+void hidl_state_free(hidl_state *s) {
+    unsigned i;
+
+    pa_assert(s);
+
+    for (i = 0; i < s->n_entries; i++) {
+        pa_xfree(s->entries[i].key);
+        pa_xfree(s->entries[i].value);
+    }
+
+    pa_xfree(s->entries);
+    pa_xfree(s);
+}
+
+/* Index of the first key not less than the first len characters of key. */
+static unsigned lower_bound(hidl_state *s, const char *key, size_t len) {
+    unsigned lo = 0;
+    unsigned hi = s->n_entries;
+    unsigned mid;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (strncmp(s->entries[mid].key, key, len) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    return lo;
+}
+
+static void update_key(hidl_state *s, const char *key, const char *value, pa_usec_t now) {
+    hidl_state_entry *e;
+    unsigned i;
+
+    i = lower_bound(s, key, strlen(key) + 1);
+
+    if (i < s->n_entries && pa_streq(s->entries[i].key, key)) {
+        e = &s->entries[i];
+        if (!pa_streq(e->value, value)) {
+            pa_xfree(e->value);
+            e->value = pa_xstrdup(value);
+        }
+        e->updated = now;
+        return;
+    }
+
+    if (s->n_entries == s->max_keys) {
+        pa_log_debug("Parameter state full, not tracking %s.", key);
+        return;
+    }
+
+    if (s->n_entries == s->size) {
+        s->size = s->size ? s->size * 2 : 32;
+        s->entries = pa_xrenew(hidl_state_entry, s->entries, s->size);
+    }
+
+    memmove(&s->entries[i + 1], &s->entries[i], (s->n_entries - i) * sizeof(hidl_state_entry));
+    s->n_entries++;
+
+    e = &s->entries[i];
+    e->key = pa_xstrdup(key);
+    e->value = pa_xstrdup(value);
+    e->updated = now;
+}
+
+void hidl_state_update(hidl_state *s, const char *key_value_pairs) {
+    const char *state = NULL;
+    char *pair;
+    char *value;
+    pa_usec_t now;
+
+    pa_assert(s);
+    pa_assert(key_value_pairs);
+
+    now = pa_rtclock_now();
+
+    while ((pair = pa_split(key_value_pairs, ";", &state))) {
+        if ((value = strchr(pair, '='))) {
+            *value++ = '\0';
+            update_key(s, pair, value, now);
+        }
+        pa_xfree(pair);
+    }
+}
+
+unsigned hidl_state_query(hidl_state *s, const char *pattern, hidl_state_cb_t cb, void *userdata) {
+    size_t prefix;
+    unsigned matches = 0;
+    unsigned i;
+
+    pa_assert(s);
+    pa_assert(pattern);
+    pa_assert(cb);
+
+    /* Only keys starting with the literal part of the pattern can match. */
+    prefix = strcspn(pattern, "*?[\\");
+
+    for (i = lower_bound(s, pattern, prefix);
+         i < s->n_entries && strncmp(s->entries[i].key, pattern, prefix) == 0;
+         i++) {
+        if (fnmatch(pattern, s->entries[i].key, 0) == 0) {
+            cb(&s->entries[i], userdata);
+            matches++;
+        }
+    }
+
+    return matches;
+}
+
+unsigned hidl_state_size(hidl_state *s) {
+    pa_assert(s);
+
+    return s->n_entries;
+}
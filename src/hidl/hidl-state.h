@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlstatefoo
+#define foohidlstatefoo
+
+#include <pulse/sample.h>
+
+/* Latest known value of every key seen in HAL replies and successful
+ * writes.
+ *
+ * Keys are kept sorted, so a glob pattern is answered by a binary search
+ * for its literal prefix and matching only the keys sharing the prefix.
+ * At most a fixed number of keys are tracked, further new keys are
+ * ignored. */
+
+typedef struct hidl_state hidl_state;
+
+typedef struct hidl_state_entry {
+    char *key;
+    char *value;
+    /* pa_rtclock_now() of the latest update */
+    pa_usec_t updated;
+} hidl_state_entry;
+
+typedef void (*hidl_state_cb_t)(const hidl_state_entry *entry, void *userdata);
+
+hidl_state *hidl_state_new(unsigned max_keys);
+void hidl_state_free(hidl_state *s);
+
+void hidl_state_update(hidl_state *s, const char *key_value_pairs);
+
+/* Call cb for keys matching glob pattern, in key order. Returns number of
+ * matching keys. */
+unsigned hidl_state_query(hidl_state *s, const char *pattern, hidl_state_cb_t cb, void *userdata);
+
+unsigned hidl_state_size(hidl_state *s);
+
+#endif
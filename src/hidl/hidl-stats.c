@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/macro.h>
+
+#include "hidl-stats.h"
+
+struct hidl_stats {
+    unsigned size;
+    unsigned n_entries;
+    hidl_stats_entry *entries;
+    /* key -> hidl_stats_entry, keys owned by entries */
+    pa_hashmap *index;
+};
+
+hidl_stats *hidl_stats_new(unsigned size) {
+    hidl_stats *s;
+
+    pa_assert(size > 0);
+
+    s = pa_xnew0(hidl_stats, 1);
+    s->size = size;
+    s->entries = pa_xnew0(hidl_stats_entry, size);
+    s->index = pa_hashmap_new(pa_idxset_string_hash_func, pa_idxset_string_compare_func);
+
+    return s;
+}
+
+void hidl_stats_free(hidl_stats *s) {
+    unsigned i;
+
+    pa_assert(s);
+
+    pa_hashmap_free(s->index);
+
+    for (i = 0; i < s->n_entries; i++) {
+        pa_xfree(s->entries[i].key);
+        pa_xfree(s->entries[i].last_value);
+    }
+
+    pa_xfree(s->entries);
+    pa_xfree(s);
+}
+
+static hidl_stats_entry *stats_min(hidl_stats *s) {
+    hidl_stats_entry *min;
+    unsigned i;
+
+    min = &s->entries[0];
+    for (i = 1; i < s->n_entries; i++) {
+        if (s->entries[i].count < min->count)
+            min = &s->entries[i];
+    }
+
+    return min;
+}
+
+/* Find entry for key, taking over the least frequent entry if needed.
+ * Count is incremented. */
+static hidl_stats_entry *stats_hit(hidl_stats *s, const char *key) {
+    hidl_stats_entry *e;
+    uint64_t count;
+
+    if ((e = pa_hashmap_get(s->index, key))) {
+        e->count++;
+        return e;
+    }
+
+    if (s->n_entries < s->size) {
+        e = &s->entries[s->n_entries++];
+        count = 0;
+    } else {
+        e = stats_min(s);
+        count = e->count;
+        pa_hashmap_remove(s->index, e->key);
+        pa_xfree(e->key);
+        pa_xfree(e->last_value);
+    }
+
+    memset(e, 0, sizeof(*e));
+    e->key = pa_xstrdup(key);
+    e->count = count + 1;
+    e->error = count;
+    pa_hashmap_put(s->index, e->key, e);
+
+    return e;
+}
+
+void hidl_stats_read(hidl_stats *s, const char *key) {
+    pa_assert(s);
+    pa_assert(key);
+
+    stats_hit(s, key)->reads++;
+}
+
+void hidl_stats_write(hidl_stats *s, const char *key, const char *value) {
+    hidl_stats_entry *e;
+
+    pa_assert(s);
+    pa_assert(key);
+    pa_assert(value);
+
+    e = stats_hit(s, key);
+    e->writes++;
+
+    if (e->last_value && pa_streq(e->last_value, value))
+        e->redundant_writes++;
+    else {
+        pa_xfree(e->last_value);
+        e->last_value = pa_xstrdup(value);
+    }
+}
+
+void hidl_stats_hal_time(hidl_stats *s, const char *key, pa_usec_t usec) {
+    hidl_stats_entry *e;
+
+    pa_assert(s);
+    pa_assert(key);
+
+    if ((e = pa_hashmap_get(s->index, key)))
+        e->hal_usec += usec;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    const hidl_stats_entry *ea = *(const hidl_stats_entry * const *) a;
+    const hidl_stats_entry *eb = *(const hidl_stats_entry * const *) b;
+
+    if (ea->count == eb->count)
+        return 0;
+
+    return ea->count > eb->count ? -1 : 1;
+}
+
+unsigned hidl_stats_top(hidl_stats *s, const hidl_stats_entry **entries, unsigned n) {
+    const hidl_stats_entry **all;
+    unsigned i;
+
+    pa_assert(s);
+    pa_assert(entries);
+
+    all = pa_xnew(const hidl_stats_entry *, s->n_entries + 1);
+    for (i = 0; i < s->n_entries; i++)
+        all[i] = &s->entries[i];
+
+    qsort(all, s->n_entries, sizeof(*all), entry_cmp);
+
+    n = PA_MIN(n, s->n_entries);
+    for (i = 0; i < n; i++)
+        entries[i] = all[i];
+
+    pa_xfree(all);
+
+    return n;
+}
+
+void hidl_stats_append(hidl_stats *s, unsigned n, DBusMessageIter *iter) {
+    DBusMessageIter array, entry;
+    const hidl_stats_entry **entries;
+    unsigned i;
+
+    pa_assert(s);
+    pa_assert(iter);
+
+    entries = pa_xnew(const hidl_stats_entry *, n + 1);
+    n = hidl_stats_top(s, entries, n);
+
+    pa_assert_se(dbus_message_iter_open_container(iter, DBUS_TYPE_ARRAY, HIDL_STATS_ENTRY_SIGNATURE, &array));
+
+    for (i = 0; i < n; i++) {
+        const char *key = entries[i]->key;
+
+        pa_assert_se(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &entries[i]->count));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &entries[i]->error));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &entries[i]->reads));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &entries[i]->writes));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &entries[i]->redundant_writes));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &entries[i]->hal_usec));
+        pa_assert_se(dbus_message_iter_close_container(&array, &entry));
+    }
+
+    pa_assert_se(dbus_message_iter_close_container(iter, &array));
+    pa_xfree(entries);
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlstatsfoo
+#define foohidlstatsfoo
+
+#include <stdint.h>
+
+#include <dbus/dbus.h>
+
+#include <pulse/sample.h>
+
+/* Per-key traffic counters in constant space.
+ *
+ * Only a fixed number of keys are tracked, using the Space-Saving
+ * algorithm: when a new key arrives and the table is full, the entry with
+ * the lowest count is taken over by the new key, which inherits the count
+ * and remembers it as the error bound. Frequent keys are thus always
+ * tracked, and their count is overestimated by at most error. */
+
+typedef struct hidl_stats hidl_stats;
+
+typedef struct hidl_stats_entry {
+    char *key;
+    uint64_t count;
+    uint64_t error;
+    uint64_t reads;
+    uint64_t writes;
+    uint64_t redundant_writes;
+    pa_usec_t hal_usec;
+    char *last_value;
+} hidl_stats_entry;
+
+hidl_stats *hidl_stats_new(unsigned size);
+void hidl_stats_free(hidl_stats *s);
+
+void hidl_stats_read(hidl_stats *s, const char *key);
+void hidl_stats_write(hidl_stats *s, const char *key, const char *value);
+/* HAL time is accounted only to keys currently tracked. */
+void hidl_stats_hal_time(hidl_stats *s, const char *key, pa_usec_t usec);
+
+/* Fill entries with at most n most frequent keys, in descending order.
+ * Entries are valid until the next update. Returns number of entries. */
+unsigned hidl_stats_top(hidl_stats *s, const hidl_stats_entry **entries, unsigned n);
+
+/* D-Bus signature of an entry: key, count, error, reads, writes,
+ * redundant writes and HAL usec. */
+#define HIDL_STATS_ENTRY_SIGNATURE  "(stttttt)"
+
+/* Append at most n most frequent keys to iter as an array of entries. */
+void hidl_stats_append(hidl_stats *s, unsigned n, DBusMessageIter *iter);
+
+#endif
@@ -0,0 +1,427 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <dbus/dbus.h>
+
+#include <pulse/mainloop.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/modargs.h>
+#include <pulsecore/strbuf.h>
+
+#include "hidl-admission.h"
+#include "hidl-journal.h"
+#include "hidl-passthrough.h"
+#include "hidl-sched.h"
+#include "hidl-state.h"
+#include "hidl-stats.h"
+#include "mock-audio-hw.h"
+
+/* Tests of the passthrough and its helpers against a fake HAL, run with
+ * "make check". Failures abort. */
+
+#define JOURNAL_TEST_SIZE   (256)
+
+static hidl_passthrough *passthrough_new(pa_core *core, const char *args) {
+    hidl_passthrough *p;
+    pa_modargs *ma;
+
+    pa_assert_se(ma = pa_modargs_new(args, NULL));
+    pa_assert_se(p = hidl_passthrough_new(core, ma));
+    pa_modargs_free(ma);
+    pa_assert_se(hidl_passthrough_attach(p));
+
+    return p;
+}
+
+/* Compare reply of get to expected and free it. */
+static void assert_get(hidl_passthrough *p, const char *keys, const char *expected) {
+    char *reply;
+
+    reply = hidl_passthrough_get(p, NULL, keys);
+    if (!pa_streq(reply, expected)) {
+        fprintf(stderr, "get_parameters(\"%s\") returned \"%s\", expected \"%s\"\n", keys, reply, expected);
+        pa_assert_not_reached();
+    }
+    pa_xfree(reply);
+}
+
+/* Payload of the most recent call of the fake HAL. */
+static const char *last_call(mock_audio_hw *hw) {
+    const mock_audio_hw_call *call;
+
+    pa_assert_se(mock_audio_hw_call_log(hw, &call, 1) == 1);
+
+    return call->payload;
+}
+
+static char *temp_path(void) {
+    char *path;
+    int fd;
+
+    path = pa_sprintf_malloc("%s/hidl-test-XXXXXX", getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    pa_assert_se((fd = mkstemp(path)) >= 0);
+    pa_close(fd);
+
+    return path;
+}
+
+static void test_negative_cache(pa_core *core) {
+    hidl_passthrough *p;
+    mock_audio_hw *hw;
+    unsigned calls;
+
+    hw = mock_audio_hw_new("primary");
+    mock_audio_hw_set_value(hw, "supported", "1");
+    p = passthrough_new(core, "negative_cache=true negative_cache_ttl=1");
+
+    /* Keys missing from the reply are not asked again. */
+    calls = mock_audio_hw_calls(hw, MOCK_AUDIO_HW_GET);
+    assert_get(p, "supported;unsupported", "supported=1");
+    assert_get(p, "unsupported", "");
+    pa_assert_se(mock_audio_hw_calls(hw, MOCK_AUDIO_HW_GET) == calls + 1);
+    assert_get(p, "supported;unsupported", "supported=1");
+    pa_assert_se(pa_streq(last_call(hw), "supported"));
+
+    /* Setting a key forgets it. */
+    pa_assert_se(hidl_passthrough_set(p, NULL, "unsupported=2") == 0);
+    assert_get(p, "unsupported", "unsupported=2");
+
+    /* Route change forgets all keys. */
+    assert_get(p, "other", "");
+    calls = mock_audio_hw_calls(hw, MOCK_AUDIO_HW_GET);
+    assert_get(p, "other", "");
+    pa_assert_se(mock_audio_hw_calls(hw, MOCK_AUDIO_HW_GET) == calls);
+    pa_assert_se(hidl_passthrough_set(p, NULL, "routing=2") == 0);
+    assert_get(p, "other", "");
+    pa_assert_se(mock_audio_hw_calls(hw, MOCK_AUDIO_HW_GET) == calls + 1);
+
+    /* Entries expire. */
+    pa_msleep(1100);
+    assert_get(p, "other", "");
+    pa_assert_se(mock_audio_hw_calls(hw, MOCK_AUDIO_HW_GET) == calls + 2);
+
+    hidl_passthrough_free(p);
+    mock_audio_hw_free(hw);
+}
+
+static void test_journal(pa_core *core) {
+    hidl_passthrough *p;
+    hidl_journal *j;
+    mock_audio_hw *hw;
+    char *path;
+    char *args;
+    char value[16];
+    unsigned i;
+
+    path = temp_path();
+
+    /* Updates of one key overflow the journal several times over. */
+    pa_assert_se(j = hidl_journal_open(path, JOURNAL_TEST_SIZE));
+    hidl_journal_update(j, "other_1", "a");
+    hidl_journal_update(j, "other_2", "b");
+    for (i = 0; i < 100; i++) {
+        pa_snprintf(value, sizeof(value), "%u", i);
+        hidl_journal_update(j, "key", value);
+    }
+    hidl_journal_free(j);
+
+    pa_assert_se(j = hidl_journal_open(path, JOURNAL_TEST_SIZE));
+    pa_assert_se(pa_hashmap_size(hidl_journal_state(j)) == 3);
+    pa_assert_se(pa_streq(pa_hashmap_get(hidl_journal_state(j), "key"), "99"));
+    pa_assert_se(pa_streq(pa_hashmap_get(hidl_journal_state(j), "other_1"), "a"));
+    pa_assert_se(pa_streq(pa_hashmap_get(hidl_journal_state(j), "other_2"), "b"));
+    hidl_journal_free(j);
+
+    /* Restore keys are applied again when attaching. */
+    hw = mock_audio_hw_new("primary");
+    args = pa_sprintf_malloc("restore_keys=restored state_file=%s", path);
+
+    p = passthrough_new(core, args);
+    pa_assert_se(hidl_passthrough_set(p, NULL, "restored=1;other=2") == 0);
+    pa_assert_se(hidl_passthrough_set(p, NULL, "restored=3") == 0);
+    hidl_passthrough_free(p);
+
+    p = passthrough_new(core, args);
+    pa_assert_se(pa_streq(last_call(hw), "restored=3"));
+    hidl_passthrough_free(p);
+
+    mock_audio_hw_free(hw);
+    pa_xfree(args);
+    unlink(path);
+    pa_xfree(path);
+}
+
+static void test_routing(pa_core *core) {
+    hidl_passthrough *p;
+    mock_audio_hw *primary;
+    mock_audio_hw *voice;
+    unsigned calls;
+
+    primary = mock_audio_hw_new("primary");
+    voice = mock_audio_hw_new("voice");
+    p = passthrough_new(core, "module_ids=primary,voice key_routes=voice:vsid*,call_state");
+
+    /* Keys are split by pattern, unrouted keys go to the first hw module. */
+    pa_assert_se(hidl_passthrough_set(p, NULL, "vsid_1=1;volume=2;call_state=3") == 0);
+    pa_assert_se(pa_streq(last_call(voice), "vsid_1=1;call_state=3"));
+    pa_assert_se(pa_streq(last_call(primary), "volume=2"));
+
+    /* Replies are merged in hw module order. */
+    assert_get(p, "vsid_1;volume", "volume=2;vsid_1=1");
+
+    /* Empty queries go to the first hw module. */
+    calls = mock_audio_hw_calls(voice, MOCK_AUDIO_HW_GET);
+    assert_get(p, "", "");
+    pa_assert_se(pa_streq(last_call(primary), ""));
+    pa_assert_se(mock_audio_hw_calls(voice, MOCK_AUDIO_HW_GET) == calls);
+
+    hidl_passthrough_free(p);
+    mock_audio_hw_free(voice);
+    mock_audio_hw_free(primary);
+}
+
+static void test_stats(void) {
+    const hidl_stats_entry *entries[3];
+    hidl_stats *s;
+    unsigned i;
+
+    s = hidl_stats_new(2);
+
+    for (i = 0; i < 5; i++)
+        hidl_stats_read(s, "frequent");
+    for (i = 0; i < 3; i++)
+        hidl_stats_write(s, "rare", "1");
+
+    /* The least frequent entry is taken over and its count inherited. */
+    hidl_stats_read(s, "new");
+
+    pa_assert_se(hidl_stats_top(s, entries, 3) == 2);
+    pa_assert_se(pa_streq(entries[0]->key, "frequent"));
+    pa_assert_se(entries[0]->count == 5 && entries[0]->error == 0);
+    pa_assert_se(pa_streq(entries[1]->key, "new"));
+    pa_assert_se(entries[1]->count == 4 && entries[1]->error == 3);
+    pa_assert_se(entries[1]->reads == 1 && entries[1]->writes == 0);
+
+    hidl_stats_free(s);
+}
+
+/* Statistics as returned by GetStatistics. */
+static void test_stats_reply(void) {
+    DBusMessage *msg;
+    DBusMessageIter iter, array, entry;
+    hidl_stats *s;
+    const char *key;
+    uint64_t values[6];
+    unsigned i;
+
+    s = hidl_stats_new(4);
+    hidl_stats_read(s, "read");
+    hidl_stats_write(s, "written", "1");
+    hidl_stats_write(s, "written", "1");
+    hidl_stats_hal_time(s, "written", 10);
+
+    pa_assert_se(msg = dbus_message_new_signal("/test", "org.test", "Test"));
+    dbus_message_iter_init_append(msg, &iter);
+    hidl_stats_append(s, 1, &iter);
+    pa_assert_se(pa_streq(dbus_message_get_signature(msg), "a" HIDL_STATS_ENTRY_SIGNATURE));
+
+    pa_assert_se(dbus_message_iter_init(msg, &iter));
+    dbus_message_iter_recurse(&iter, &array);
+    pa_assert_se(dbus_message_iter_get_arg_type(&array) == DBUS_TYPE_STRUCT);
+    dbus_message_iter_recurse(&array, &entry);
+    dbus_message_iter_get_basic(&entry, &key);
+    pa_assert_se(pa_streq(key, "written"));
+    for (i = 0; i < 6; i++) {
+        pa_assert_se(dbus_message_iter_next(&entry));
+        pa_assert_se(dbus_message_iter_get_arg_type(&entry) == DBUS_TYPE_UINT64);
+        dbus_message_iter_get_basic(&entry, &values[i]);
+    }
+    pa_assert_se(!dbus_message_iter_next(&entry));
+    /* count, error, reads, writes, redundant writes, HAL usec */
+    pa_assert_se(values[0] == 2 && values[1] == 0 && values[2] == 0);
+    pa_assert_se(values[3] == 2 && values[4] == 1 && values[5] == 10);
+    pa_assert_se(!dbus_message_iter_next(&array));
+
+    dbus_message_unref(msg);
+    hidl_stats_free(s);
+}
+
+static void test_admission(void) {
+    hidl_admission *a;
+    hidl_admission_client *client;
+    hidl_admission_client *helper;
+
+    a = hidl_admission_new(1, 2, 4);
+    client = hidl_admission_client_new(a, "client", false, NULL);
+    helper = hidl_admission_client_new(a, "helper", true, NULL);
+
+    /* Burst is allowed, then the rate applies. */
+    pa_assert_se(hidl_admission_check(client, 0) == HIDL_ADMISSION_ACCEPT);
+    pa_assert_se(hidl_admission_check(client, 0) == HIDL_ADMISSION_ACCEPT);
+    pa_assert_se(hidl_admission_check(client, 0) == HIDL_ADMISSION_RATE_LIMITED);
+    pa_assert_se(hidl_admission_check(client, 4) == HIDL_ADMISSION_QUEUE_FULL);
+
+    pa_assert_se(client->accepted == 2);
+    pa_assert_se(client->rate_limited == 1);
+    pa_assert_se(client->queue_full == 1);
+
+    /* Exempt clients are only counted. */
+    pa_assert_se(hidl_admission_check(helper, 0) == HIDL_ADMISSION_ACCEPT);
+    pa_assert_se(hidl_admission_check(helper, 0) == HIDL_ADMISSION_ACCEPT);
+    pa_assert_se(hidl_admission_check(helper, 0) == HIDL_ADMISSION_ACCEPT);
+    pa_assert_se(hidl_admission_check(helper, 4) == HIDL_ADMISSION_ACCEPT);
+    pa_assert_se(helper->accepted == 4);
+
+    hidl_admission_client_free(helper);
+    hidl_admission_client_free(client);
+    hidl_admission_free(a);
+}
+
+static void state_cb(const hidl_state_entry *entry, void *userdata) {
+    pa_strbuf *buf = userdata;
+
+    pa_strbuf_printf(buf, "%s%s=%s", pa_strbuf_isempty(buf) ? "" : ";", entry->key, entry->value);
+}
+
+static void assert_query(hidl_state *s, const char *pattern, const char *expected) {
+    pa_strbuf *buf;
+    char *result;
+
+    buf = pa_strbuf_new();
+    hidl_state_query(s, pattern, state_cb, buf);
+    result = pa_strbuf_to_string_free(buf);
+
+    if (!pa_streq(result, expected)) {
+        fprintf(stderr, "query \"%s\" returned \"%s\", expected \"%s\"\n", pattern, result, expected);
+        pa_assert_not_reached();
+    }
+
+    pa_xfree(result);
+}
+
+static void test_state(void) {
+    hidl_state *s;
+
+    s = hidl_state_new(5);
+
+    hidl_state_update(s, "b_1=1;a_2=2;a_1=3;ab=4");
+    hidl_state_update(s, "a_2=5");
+
+    assert_query(s, "a_*", "a_1=3;a_2=5");
+    assert_query(s, "a?1", "a_1=3");
+    assert_query(s, "a*", "a_1=3;a_2=5;ab=4");
+    assert_query(s, "*_1", "a_1=3;b_1=1");
+    assert_query(s, "b_1", "b_1=1");
+    assert_query(s, "c*", "");
+
+    /* Keys beyond the limit are not tracked. */
+    hidl_state_update(s, "c=6;d=7");
+    pa_assert_se(hidl_state_size(s) == 5);
+    assert_query(s, "c*", "c=6");
+    assert_query(s, "d", "");
+
+    hidl_state_free(s);
+}
+
+struct sched_run {
+    const char *order[4];
+    unsigned n;
+};
+
+static void sched_run_cb(void *request, void *userdata) {
+    struct sched_run *r = userdata;
+
+    pa_assert_se(r->n < PA_ELEMENTSOF(r->order));
+    r->order[r->n++] = request;
+}
+
+static void test_sched(pa_mainloop *mainloop, pa_core *core) {
+    struct sched_run r = { .n = 0 };
+    hidl_sched *s;
+    int a, b;
+
+    pa_assert_se(s = hidl_sched_new(core, "high:call_state;low:vol*", 10 * PA_USEC_PER_SEC, sched_run_cb, NULL, &r));
+
+    pa_assert_se(hidl_sched_classify(s, "volume=1", false) == HIDL_SCHED_LOW);
+    pa_assert_se(hidl_sched_classify(s, "volume=1;call_state=2", false) == HIDL_SCHED_HIGH);
+    pa_assert_se(hidl_sched_classify(s, "routing=2", false) == HIDL_SCHED_NORMAL);
+
+    /* The high request of a can't overtake its low one, but b's normal
+     * request overtakes both. */
+    hidl_sched_push(s, &a, hidl_sched_classify(s, "volume=1", false), "a1");
+    hidl_sched_push(s, &a, hidl_sched_classify(s, "call_state=2", false), "a2");
+    hidl_sched_push(s, &b, hidl_sched_classify(s, "routing=2", false), "b1");
+
+    while (r.n < 3)
+        pa_mainloop_iterate(mainloop, 1, NULL);
+
+    pa_assert_se(pa_streq(r.order[0], "b1"));
+    pa_assert_se(pa_streq(r.order[1], "a1"));
+    pa_assert_se(pa_streq(r.order[2], "a2"));
+    pa_assert_se(hidl_sched_get_stats(s, HIDL_SCHED_HIGH)->count == 1);
+    pa_assert_se(hidl_sched_get_stats(s, HIDL_SCHED_LOW)->count == 1);
+
+    hidl_sched_free(s);
+}
+
+int main(int argc, char *argv[]) {
+    pa_mainloop *mainloop;
+    pa_core *core;
+
+    pa_log_set_level(PA_LOG_WARN);
+
+    mainloop = pa_mainloop_new();
+    core = pa_core_new(pa_mainloop_get_api(mainloop), false, false, 0);
+
+    test_negative_cache(core);
+    printf("negative cache: ok\n");
+    test_journal(core);
+    printf("journal: ok\n");
+    test_routing(core);
+    printf("routing: ok\n");
+    test_stats();
+    printf("stats: ok\n");
+    test_stats_reply();
+    printf("stats reply: ok\n");
+    test_admission();
+    printf("admission: ok\n");
+    test_state();
+    printf("state: ok\n");
+    test_sched(mainloop, core);
+    printf("sched: ok\n");
+
+    pa_core_unref(core);
+    pa_mainloop_free(mainloop);
+
+    return 0;
+}
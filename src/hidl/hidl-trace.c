@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/macro.h>
+
+#include "hidl-trace.h"
+
+struct hidl_trace {
+    hidl_trace_entry *entries;
+    unsigned size;
+    /* Number of entries ever added. */
+    uint64_t count;
+};
+
+hidl_trace *hidl_trace_new(unsigned size) {
+    hidl_trace *t;
+
+    pa_assert(size > 0);
+
+    t = pa_xnew0(hidl_trace, 1);
+    t->entries = pa_xnew0(hidl_trace_entry, size);
+    t->size = size;
+
+    return t;
+}
+
+static void entry_clear(hidl_trace_entry *e) {
+    pa_xfree(e->slot);
+    pa_xfree(e->payload);
+    pa_zero(*e);
+}
+
+void hidl_trace_free(hidl_trace *t) {
+    unsigned i;
+
+    pa_assert(t);
+
+    for (i = 0; i < t->size; i++)
+        entry_clear(&t->entries[i]);
+
+    pa_xfree(t->entries);
+    pa_xfree(t);
+}
+
+hidl_trace_entry *hidl_trace_add(hidl_trace *t, uint64_t boot_id, uint64_t id, const char *slot, bool set,
+                                 const char *payload) {
+    hidl_trace_entry *e;
+
+    pa_assert(t);
+
+    e = &t->entries[t->count % t->size];
+    t->count++;
+
+    entry_clear(e);
+    e->boot_id = boot_id;
+    e->id = id;
+    e->slot = pa_xstrdup(slot);
+    e->payload = pa_xstrdup(payload);
+    e->set = set;
+
+    return e;
+}
+
+hidl_trace_entry *hidl_trace_find(hidl_trace *t, uint64_t boot_id, uint64_t id) {
+    unsigned n;
+    unsigned i;
+
+    pa_assert(t);
+
+    n = (unsigned) PA_MIN(t->count, (uint64_t) t->size);
+
+    /* Reports follow their request closely, so search newest first. */
+    for (i = 1; i <= n; i++) {
+        hidl_trace_entry *e = &t->entries[(t->count - i) % t->size];
+
+        if (e->boot_id == boot_id && e->id == id)
+            return e;
+    }
+
+    return NULL;
+}
+
+unsigned hidl_trace_size(hidl_trace *t) {
+    pa_assert(t);
+
+    return t->size;
+}
+
+const hidl_trace_entry *hidl_trace_iterate(hidl_trace *t, unsigned *state) {
+    unsigned n;
+
+    pa_assert(t);
+    pa_assert(state);
+
+    n = (unsigned) PA_MIN(t->count, (uint64_t) t->size);
+
+    if (*state >= n)
+        return NULL;
+
+    return &t->entries[(t->count - n + (*state)++) % t->size];
+}
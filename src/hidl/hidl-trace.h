@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidltracefoo
+#define foohidltracefoo
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pulse/sample.h>
+
+/* Per-request stage timing of traced requests, kept for the most recent
+ * requests only.
+ *
+ * Requests coming through the *_traced methods carry an id created by
+ * the helper when the binder request arrived, and the helper's stage
+ * times so far. The module adds its own stages while handling the
+ * request, and the helper reports the remaining stages after the reply
+ * with the same id. Ids start over when the helper is restarted, so
+ * entries are matched by the boot id of the helper too. All times are
+ * CLOCK_MONOTONIC usec, 0 if unknown. */
+
+enum hidl_trace_stage {
+    HIDL_TRACE_BINDER_RECEIVED,
+    HIDL_TRACE_DBUS_SENT,
+    HIDL_TRACE_MODULE_RECEIVED,
+    HIDL_TRACE_LOCK_ACQUIRED,
+    HIDL_TRACE_HAL_RETURNED,
+    HIDL_TRACE_REPLY_SENT,
+    HIDL_TRACE_BINDER_REPLIED,
+    HIDL_TRACE_STAGES
+};
+
+typedef struct hidl_trace hidl_trace;
+
+typedef struct hidl_trace_entry {
+    uint64_t boot_id;
+    uint64_t id;
+    char *slot;
+    char *payload;
+    bool set;
+    int result;
+    pa_usec_t stage_usec[HIDL_TRACE_STAGES];
+} hidl_trace_entry;
+
+hidl_trace *hidl_trace_new(unsigned size);
+void hidl_trace_free(hidl_trace *t);
+
+/* Start a new entry, replacing the oldest one when full. */
+hidl_trace_entry *hidl_trace_add(hidl_trace *t, uint64_t boot_id, uint64_t id, const char *slot, bool set,
+                                 const char *payload);
+/* Most recent entry with boot_id and id, NULL if not found. */
+hidl_trace_entry *hidl_trace_find(hidl_trace *t, uint64_t boot_id, uint64_t id);
+unsigned hidl_trace_size(hidl_trace *t);
+
+/* Iterate entries from oldest to newest, start with *state = 0. */
+const hidl_trace_entry *hidl_trace_iterate(hidl_trace *t, unsigned *state);
+
+#endif
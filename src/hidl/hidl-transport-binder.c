@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2019 Jolla Ltd.
+ *               2019 Slava Monich <slava.monich@jolla.com>
+ *               2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * Contact: Juho Hämäläinen <juho.hamalainen@jolla.com>
+ *
+ * This application is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this application; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#include <gbinder.h>
+
+#include "hidl-helper.h"
+#include "hidl-transport.h"
+#include "hidl-wakeup.h"
+
+#define BINDER_DEVICE               GBINDER_DEFAULT_HWBINDER
+#define QCRIL_IFACE_1_0(x)          "vendor.qti.hardware.radio.am@1.0::" x
+#define QCRIL_AUDIO_1_0             QCRIL_IFACE_1_0("IQcRilAudio")
+#define QCRIL_AUDIO_CALLBACK_1_0    QCRIL_IFACE_1_0("IQcRilAudioCallback")
+
+enum qcril_audio_methods {
+    QCRIL_AUDIO_SET_CALLBACK = GBINDER_FIRST_CALL_TRANSACTION,
+    QCRIL_AUDIO_SET_ERROR
+};
+
+enum qcril_audio_callback_methods {
+    QCRIL_AUDIO_CALLBACK_GET_PARAMETERS = GBINDER_FIRST_CALL_TRANSACTION,
+    QCRIL_AUDIO_CALLBACK_SET_PARAMETERS
+};
+
+typedef struct binder_transport {
+    HidlTransport parent;
+    GBinderServiceManager* sm;
+} BinderTransport;
+
+typedef struct am_client {
+    HidlTransportSlot parent;
+    char* fqname;
+    GBinderServiceManager* sm;
+    GBinderLocalObject* local;
+    GBinderRemoteObject* remote;
+    GBinderClient* client;
+    gulong wait_id;
+    gulong death_id;
+} AmClient;
+
+static void
+am_client_registration_handler(
+        GBinderServiceManager* sm,
+        const char* name,
+        void* user_data);
+
+static void
+am_remote_died(
+        GBinderRemoteObject* obj,
+        void* user_data)
+{
+    AmClient* am = user_data;
+    gint64 wakeup = hidl_wakeup_begin();
+
+    DBG("%s has died", am->fqname);
+    gbinder_remote_object_unref(am->remote);
+    am->remote = NULL;
+
+    /* Wait for it to re-appear */
+    am->wait_id = gbinder_servicemanager_add_registration_handler(am->sm,
+        am->fqname, am_client_registration_handler, am);
+    hidl_wakeup_end(HIDL_WAKEUP_BINDER, wakeup);
+}
+
+/* IQcRilAudioCallback::getParameters(string str) generates (string) */
+static gboolean
+am_client_callback_get_parameters(
+        AmClient* am,
+        const char* str,
+        GBinderLocalReply* reply)
+{
+    if (str) {
+        gchar* result = NULL;
+        hidl_transport_slot_get_parameters(&am->parent, str, &result);
+
+        if (result) {
+            GBinderWriter writer;
+            gbinder_local_reply_init_writer(reply, &writer);
+            gbinder_writer_append_int32(&writer, 0 /* OK */);
+            gbinder_writer_append_hidl_string(&writer, result);
+
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* IQcRilAudioCallback::setParameters(string str) generates (int32_t) */
+static gboolean
+am_client_callback_set_parameters(
+        AmClient* am,
+        const char* str,
+        GBinderLocalReply* reply)
+{
+    if (str) {
+        GBinderWriter writer;
+        guint32 result = 0;
+
+        result = hidl_transport_slot_set_parameters(&am->parent, str);
+        gbinder_local_reply_init_writer(reply, &writer);
+        gbinder_writer_append_int32(&writer, 0 /* OK */);
+        gbinder_writer_append_int32(&writer, result);
+
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
+static GBinderLocalReply*
+am_client_callback_handle(
+        AmClient* am,
+        GBinderLocalObject* obj,
+        GBinderRemoteRequest* req,
+        guint code,
+        int* status)
+{
+    const char* iface = gbinder_remote_request_interface(req);
+
+    if (!g_strcmp0(iface, QCRIL_AUDIO_CALLBACK_1_0)) {
+        GBinderReader reader;
+        GBinderLocalReply* reply = gbinder_local_object_new_reply(obj);
+        const char* str;
+
+        gbinder_remote_request_init_reader(req, &reader);
+        str = gbinder_reader_read_hidl_string_c(&reader);
+        switch (code) {
+        case QCRIL_AUDIO_CALLBACK_GET_PARAMETERS:
+            DBG("IQcRilAudioCallback::getParameters %s %s", am->parent.name, str);
+            if (am_client_callback_get_parameters(am, str, reply)) {
+                return reply;
+            }
+            break;
+        case QCRIL_AUDIO_CALLBACK_SET_PARAMETERS:
+            DBG("IQcRilAudioCallback::setParameters %s %s", am->parent.name, str);
+            if (am_client_callback_set_parameters(am, str, reply)) {
+                return reply;
+            }
+            break;
+        }
+        /* We haven't used the reply */
+        gbinder_local_reply_unref(reply);
+    }
+    ERR("Unexpected callback %s %u", iface, code);
+    *status = GBINDER_STATUS_FAILED;
+    return NULL;
+}
+
+static GBinderLocalReply*
+am_client_callback(
+        GBinderLocalObject* obj,
+        GBinderRemoteRequest* req,
+        guint code,
+        guint flags,
+        int* status,
+        void* user_data)
+{
+    gint64 wakeup = hidl_wakeup_begin();
+    GBinderLocalReply* reply;
+
+    reply = am_client_callback_handle(user_data, obj, req, code, status);
+    hidl_wakeup_end(HIDL_WAKEUP_BINDER, wakeup);
+    return reply;
+}
+
+static gboolean
+am_client_connect(
+        AmClient* am)
+{
+    int status = 0;
+    am->remote = gbinder_servicemanager_get_service_sync(am->sm,
+        am->fqname, &status); /* auto-released reference */
+
+    if (am->remote) {
+        GBinderLocalRequest* req;
+
+        DBG("Connected to %s", am->fqname);
+        gbinder_remote_object_ref(am->remote);
+        am->client = gbinder_client_new(am->remote, QCRIL_AUDIO_1_0);
+        am->death_id = gbinder_remote_object_add_death_handler(am->remote,
+            am_remote_died, am);
+        am->local = gbinder_servicemanager_new_local_object(am->sm,
+            QCRIL_AUDIO_CALLBACK_1_0, am_client_callback, am);
+
+        /* oneway IQcRilAudio::setCallback(IQcRilAudioCallback) */
+        req = gbinder_client_new_request(am->client);
+        gbinder_local_request_append_local_object(req, am->local);
+        status = gbinder_client_transact_sync_oneway(am->client,
+            QCRIL_AUDIO_SET_CALLBACK, req);
+        gbinder_local_request_unref(req);
+        DBG("setCallback %s status %d", am->parent.name, status);
+        return TRUE;
+    }
+    return FALSE;
+}
+
+static void
+am_client_registration_handler(
+        GBinderServiceManager* sm,
+        const char* name,
+        void* user_data)
+{
+    AmClient* am = user_data;
+    gint64 wakeup = hidl_wakeup_begin();
+
+    if (!strcmp(name, am->fqname) && am_client_connect(am)) {
+        DBG("%s has reanimated", am->fqname);
+        gbinder_servicemanager_remove_handler(am->sm, am->wait_id);
+        am->wait_id = 0;
+    } else {
+        DBG("%s appeared", name);
+    }
+    hidl_wakeup_end(HIDL_WAKEUP_BINDER, wakeup);
+}
+
+static HidlTransportSlot*
+binder_slot_new(
+        HidlTransport* transport,
+        const char* name)
+{
+    BinderTransport* binder = (BinderTransport*) transport;
+    AmClient* am = g_new0(AmClient, 1);
+
+    am->fqname = g_strconcat(QCRIL_AUDIO_1_0, "/", name, NULL);
+    am->sm = gbinder_servicemanager_ref(binder->sm);
+    return &am->parent;
+}
+
+static void
+binder_slot_connect(
+        HidlTransportSlot* slot)
+{
+    AmClient* am = (AmClient*) slot;
+
+    if (!am_client_connect(am)) {
+        DBG("Waiting for %s", am->fqname);
+        am->wait_id = gbinder_servicemanager_add_registration_handler(am->sm,
+            am->fqname, am_client_registration_handler, am);
+    }
+}
+
+static void
+binder_slot_free(
+        HidlTransportSlot* slot)
+{
+    AmClient* am = (AmClient*) slot;
+
+    if (am->remote) {
+        gbinder_remote_object_remove_handler(am->remote, am->death_id);
+        gbinder_remote_object_unref(am->remote);
+    }
+    if (am->local) {
+        gbinder_local_object_drop(am->local);
+        gbinder_client_unref(am->client);
+    }
+    gbinder_servicemanager_remove_handler(am->sm, am->wait_id);
+    gbinder_servicemanager_unref(am->sm);
+    g_free(am->fqname);
+}
+
+static HidlTransport*
+binder_new(
+        void)
+{
+    BinderTransport* binder = g_new0(BinderTransport, 1);
+
+    binder->sm = gbinder_servicemanager_new(BINDER_DEVICE);
+    if (!binder->sm) {
+        ERR("Failed to open %s", BINDER_DEVICE);
+        g_free(binder);
+        return NULL;
+    }
+
+    return &binder->parent;
+}
+
+static void
+binder_free(
+        HidlTransport* transport)
+{
+    BinderTransport* binder = (BinderTransport*) transport;
+
+    gbinder_servicemanager_unref(binder->sm);
+}
+
+static gboolean
+binder_wait(
+        HidlTransport* transport)
+{
+    BinderTransport* binder = (BinderTransport*) transport;
+
+    return gbinder_servicemanager_wait(binder->sm, -1);
+}
+
+const HidlTransportDriver hidl_transport_binder = {
+    .name = "binder",
+    .option_group = NULL,
+    .new = binder_new,
+    .free = binder_free,
+    .wait = binder_wait,
+    .slot_new = binder_slot_new,
+    .slot_connect = binder_slot_connect,
+    .slot_free = binder_slot_free
+};
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * This application is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this application; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+/*
+ * In-memory stand-in for the QCRIL audio service. Every slot issues
+ * getParameters/setParameters requests at a fixed rate, and can be made
+ * to die and re-register periodically. Request latency and the time from
+ * re-registration to the first completed request are reported on exit.
+ */
+
+#include "hidl-helper.h"
+#include "hidl-transport.h"
+#include "hidl-wakeup.h"
+
+#define FAKE_TICK_MS                (10)
+#define FAKE_DEFAULT_RATE           (100)
+#define FAKE_DEFAULT_SET_PERCENT    (10)
+#define FAKE_DEFAULT_DOWN_MS        (1000)
+#define FAKE_DEFAULT_GET_KEYS       "bench_key_0"
+#define FAKE_DEFAULT_SET_PAIRS      "bench_key_0=0", "bench_key_0=1"
+
+typedef struct fake_transport {
+    HidlTransport parent;
+    GRand* rand;
+    gchar** get_keys;
+    gchar** set_pairs;
+    guint n_get_keys;
+    guint n_set_pairs;
+    guint duration_id;
+} FakeTransport;
+
+typedef struct fake_slot {
+    HidlTransportSlot parent;
+    FakeTransport* fake;
+    guint tick_id;
+    guint death_id;
+    gint64 last_tick;
+    gdouble budget;
+    gint64 registered;
+    guint failures;
+    guint deaths;
+    GArray* latency;
+    GArray* recovery;
+} FakeSlot;
+
+static gint fake_rate = FAKE_DEFAULT_RATE;
+static gint fake_set_percent = FAKE_DEFAULT_SET_PERCENT;
+static gint fake_die_every = 0;
+static gint fake_down = FAKE_DEFAULT_DOWN_MS;
+static gint fake_duration = 0;
+static gchar** fake_get = NULL;
+static gchar** fake_set = NULL;
+
+static GOptionEntry fake_entries[] = {
+    { "fake-rate", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+      &fake_rate, "Requests per second per slot (default 100)", "N" },
+    { "fake-get", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY,
+      &fake_get, "Keys for getParameters, may be repeated", "KEYS" },
+    { "fake-set", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_STRING_ARRAY,
+      &fake_set, "Key-value pairs for setParameters, may be repeated", "PAIRS" },
+    { "fake-set-percent", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+      &fake_set_percent, "Percentage of setParameters requests (default 10)", "PERCENT" },
+    { "fake-die-every", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+      &fake_die_every, "Simulate service death after being up for given time", "MS" },
+    { "fake-down", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+      &fake_down, "Time until dead service re-registers (default 1000)", "MS" },
+    { "fake-duration", 0, G_OPTION_FLAG_NONE, G_OPTION_ARG_INT,
+      &fake_duration, "Exit after given time", "SEC" },
+    { NULL, 0, 0, 0, NULL, NULL, NULL }
+};
+
+static void
+fake_slot_up(
+        FakeSlot* fs);
+
+static gint
+sample_cmp(
+        gconstpointer a,
+        gconstpointer b)
+{
+    gint64 sa = *(const gint64*) a;
+    gint64 sb = *(const gint64*) b;
+
+    return sa < sb ? -1 : sa > sb;
+}
+
+static gint64
+percentile(
+        GArray* samples,
+        guint percent)
+{
+    guint index = samples->len * percent / 100;
+
+    if (index >= samples->len)
+        index = samples->len - 1;
+
+    return g_array_index(samples, gint64, index);
+}
+
+static void
+fake_slot_request(
+        FakeSlot* fs)
+{
+    FakeTransport* fake = fs->fake;
+    gboolean ok;
+    gint64 t;
+
+    t = g_get_monotonic_time();
+
+    if (g_rand_int_range(fake->rand, 0, 100) < fake_set_percent) {
+        const gchar* pairs = fake->set_pairs[g_rand_int_range(fake->rand, 0, fake->n_set_pairs)];
+
+        ok = hidl_transport_slot_set_parameters(&fs->parent, pairs) == 0;
+    } else {
+        const gchar* keys = fake->get_keys[g_rand_int_range(fake->rand, 0, fake->n_get_keys)];
+        gchar* result = NULL;
+
+        ok = hidl_transport_slot_get_parameters(&fs->parent, keys, &result) && result;
+        g_free(result);
+    }
+
+    if (ok) {
+        gint64 now = g_get_monotonic_time();
+
+        t = now - t;
+        g_array_append_val(fs->latency, t);
+
+        if (fs->registered) {
+            t = now - fs->registered;
+            g_array_append_val(fs->recovery, t);
+            DBG("%s recovered in %" G_GINT64_FORMAT " us", fs->parent.name, t);
+            fs->registered = 0;
+        }
+    } else
+        fs->failures++;
+}
+
+static gboolean
+fake_slot_tick(
+        gpointer user_data)
+{
+    FakeSlot* fs = user_data;
+    gint64 now = g_get_monotonic_time();
+    gint64 wakeup = hidl_wakeup_begin();
+
+    /* Open loop: requests falling behind because of slow replies are
+     * caught up, but never more than one second worth of them. */
+    fs->budget += (gdouble) fake_rate * (now - fs->last_tick) / G_TIME_SPAN_SECOND;
+    if (fs->budget > fake_rate)
+        fs->budget = fake_rate;
+    fs->last_tick = now;
+
+    while (fs->budget >= 1.0 && fs->tick_id) {
+        fake_slot_request(fs);
+        fs->budget -= 1.0;
+    }
+
+    /* Stands in for binder transactions. */
+    hidl_wakeup_end(HIDL_WAKEUP_BINDER, wakeup);
+    return G_SOURCE_CONTINUE;
+}
+
+static gboolean
+fake_slot_reregister(
+        gpointer user_data)
+{
+    FakeSlot* fs = user_data;
+
+    fs->death_id = 0;
+    DBG("%s has reanimated", fs->parent.name);
+    fs->registered = g_get_monotonic_time();
+    fake_slot_up(fs);
+
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean
+fake_slot_die(
+        gpointer user_data)
+{
+    FakeSlot* fs = user_data;
+
+    DBG("%s has died", fs->parent.name);
+    fs->deaths++;
+    g_source_remove(fs->tick_id);
+    fs->tick_id = 0;
+    fs->death_id = g_timeout_add(fake_down, fake_slot_reregister, fs);
+
+    return G_SOURCE_REMOVE;
+}
+
+static void
+fake_slot_up(
+        FakeSlot* fs)
+{
+    fs->last_tick = g_get_monotonic_time();
+    fs->budget = 0;
+    fs->tick_id = g_timeout_add(FAKE_TICK_MS, fake_slot_tick, fs);
+
+    if (fake_die_every > 0)
+        fs->death_id = g_timeout_add(fake_die_every, fake_slot_die, fs);
+}
+
+static void
+fake_slot_report(
+        FakeSlot* fs)
+{
+    g_print("%s: %u requests, %u failed, %u deaths\n",
+            fs->parent.name, fs->latency->len, fs->failures, fs->deaths);
+
+    if (fs->latency->len) {
+        g_array_sort(fs->latency, sample_cmp);
+        g_print("%s: latency p50 %" G_GINT64_FORMAT " us p99 %" G_GINT64_FORMAT
+                " us max %" G_GINT64_FORMAT " us\n",
+                fs->parent.name,
+                percentile(fs->latency, 50),
+                percentile(fs->latency, 99),
+                g_array_index(fs->latency, gint64, fs->latency->len - 1));
+    }
+
+    if (fs->recovery->len) {
+        g_array_sort(fs->recovery, sample_cmp);
+        g_print("%s: recovery p50 %" G_GINT64_FORMAT " us max %" G_GINT64_FORMAT " us\n",
+                fs->parent.name,
+                percentile(fs->recovery, 50),
+                g_array_index(fs->recovery, gint64, fs->recovery->len - 1));
+    }
+}
+
+static HidlTransportSlot*
+fake_slot_new(
+        HidlTransport* transport,
+        const char* name)
+{
+    FakeSlot* fs = g_new0(FakeSlot, 1);
+
+    fs->fake = (FakeTransport*) transport;
+    fs->latency = g_array_new(FALSE, FALSE, sizeof(gint64));
+    fs->recovery = g_array_new(FALSE, FALSE, sizeof(gint64));
+    return &fs->parent;
+}
+
+static void
+fake_slot_connect(
+        HidlTransportSlot* slot)
+{
+    FakeSlot* fs = (FakeSlot*) slot;
+
+    DBG("Connected to fake %s", slot->name);
+    fake_slot_up(fs);
+}
+
+static void
+fake_slot_free(
+        HidlTransportSlot* slot)
+{
+    FakeSlot* fs = (FakeSlot*) slot;
+
+    if (fs->tick_id)
+        g_source_remove(fs->tick_id);
+    if (fs->death_id)
+        g_source_remove(fs->death_id);
+
+    fake_slot_report(fs);
+    g_array_free(fs->latency, TRUE);
+    g_array_free(fs->recovery, TRUE);
+}
+
+static gboolean
+fake_duration_cb(
+        gpointer user_data)
+{
+    FakeTransport* fake = user_data;
+
+    fake->duration_id = 0;
+    hidl_transport_quit(&fake->parent);
+
+    return G_SOURCE_REMOVE;
+}
+
+static GOptionGroup*
+fake_option_group(
+        void)
+{
+    GOptionGroup* group;
+
+    group = g_option_group_new("fake", "Fake transport options:",
+                               "Show fake transport options", NULL, NULL);
+    g_option_group_add_entries(group, fake_entries);
+
+    return group;
+}
+
+static HidlTransport*
+fake_new(
+        void)
+{
+    static const gchar* default_get_keys[] = { FAKE_DEFAULT_GET_KEYS, NULL };
+    static const gchar* default_set_pairs[] = { FAKE_DEFAULT_SET_PAIRS, NULL };
+    FakeTransport* fake;
+
+    if (fake_rate < 1 || fake_set_percent < 0 || fake_set_percent > 100 ||
+        fake_die_every < 0 || fake_down < 0 || fake_duration < 0) {
+        ERR("Invalid fake transport options");
+        return NULL;
+    }
+
+    fake = g_new0(FakeTransport, 1);
+    fake->rand = g_rand_new_with_seed(0);
+    fake->get_keys = g_strdupv(fake_get ? fake_get : (gchar**) default_get_keys);
+    fake->set_pairs = g_strdupv(fake_set ? fake_set : (gchar**) default_set_pairs);
+    fake->n_get_keys = g_strv_length(fake->get_keys);
+    fake->n_set_pairs = g_strv_length(fake->set_pairs);
+
+    if (fake_duration > 0)
+        fake->duration_id = g_timeout_add_seconds(fake_duration, fake_duration_cb, fake);
+
+    return &fake->parent;
+}
+
+static void
+fake_free(
+        HidlTransport* transport)
+{
+    FakeTransport* fake = (FakeTransport*) transport;
+
+    if (fake->duration_id)
+        g_source_remove(fake->duration_id);
+
+    g_rand_free(fake->rand);
+    g_strfreev(fake->get_keys);
+    g_strfreev(fake->set_pairs);
+}
+
+static gboolean
+fake_wait(
+        HidlTransport* transport)
+{
+    return TRUE;
+}
+
+const HidlTransportDriver hidl_transport_fake = {
+    .name = "fake",
+    .option_group = fake_option_group,
+    .new = fake_new,
+    .free = fake_free,
+    .wait = fake_wait,
+    .slot_new = fake_slot_new,
+    .slot_connect = fake_slot_connect,
+    .slot_free = fake_slot_free
+};
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * This application is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this application; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#include "hidl-probes.h"
+#include "hidl-transport.h"
+
+static const HidlTransportDriver* const drivers[] = {
+    &hidl_transport_binder,
+    &hidl_transport_fake
+};
+
+const HidlTransportDriver*
+hidl_transport_find(
+        const char *name)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(drivers); i++) {
+        if (!g_strcmp0(drivers[i]->name, name))
+            return drivers[i];
+    }
+
+    return NULL;
+}
+
+void
+hidl_transport_add_option_groups(
+        GOptionContext *options)
+{
+    guint i;
+
+    for (i = 0; i < G_N_ELEMENTS(drivers); i++) {
+        if (drivers[i]->option_group)
+            g_option_context_add_group(options, drivers[i]->option_group());
+    }
+}
+
+HidlTransport*
+hidl_transport_new(
+        const HidlTransportDriver *driver,
+        const HidlTransportHandler *handler,
+        gpointer user_data)
+{
+    HidlTransport *transport;
+
+    g_assert(driver);
+    g_assert(handler);
+
+    if ((transport = driver->new())) {
+        transport->driver = driver;
+        transport->handler = handler;
+        transport->user_data = user_data;
+    }
+
+    return transport;
+}
+
+void
+hidl_transport_free(
+        HidlTransport *transport)
+{
+    if (transport) {
+        transport->driver->free(transport);
+        g_free(transport);
+    }
+}
+
+gboolean
+hidl_transport_wait(
+        HidlTransport *transport)
+{
+    g_assert(transport);
+
+    return transport->driver->wait(transport);
+}
+
+HidlTransportSlot*
+hidl_transport_slot_new(
+        HidlTransport *transport,
+        const char *name)
+{
+    HidlTransportSlot *slot;
+
+    g_assert(transport);
+    g_assert(name);
+
+    slot = transport->driver->slot_new(transport, name);
+    slot->transport = transport;
+    slot->name = g_strdup(name);
+
+    return slot;
+}
+
+void
+hidl_transport_slot_connect(
+        HidlTransportSlot *slot)
+{
+    g_assert(slot);
+
+    slot->transport->driver->slot_connect(slot);
+}
+
+void
+hidl_transport_slot_free(
+        gpointer data)
+{
+    HidlTransportSlot *slot = data;
+
+    if (slot) {
+        slot->transport->driver->slot_free(slot);
+        g_free(slot->name);
+        g_free(slot);
+    }
+}
+
+static void
+request_init(
+        HidlTransportRequest *request,
+        HidlTransportSlot *slot)
+{
+    static guint64 request_id;
+
+    request->received = g_get_monotonic_time();
+    request->slot = slot->name;
+    request->id = ++request_id;
+}
+
+gboolean
+hidl_transport_slot_get_parameters(
+        HidlTransportSlot *slot,
+        const char *keys,
+        gchar **reply_values)
+{
+    HidlTransport *transport = slot->transport;
+    HidlTransportRequest request;
+    gboolean ok;
+
+    request_init(&request, slot);
+    HIDL_PROBE3(binder_entry, request.slot, 0, keys);
+    ok = transport->handler->get_parameters(&request, keys, reply_values, transport->user_data);
+    HIDL_PROBE5(binder_exit, request.slot, 0, keys, ok ? 0 : -1, g_get_monotonic_time() - request.received);
+
+    return ok;
+}
+
+gint
+hidl_transport_slot_set_parameters(
+        HidlTransportSlot *slot,
+        const char *key_value_pairs)
+{
+    HidlTransport *transport = slot->transport;
+    HidlTransportRequest request;
+    gint ret;
+
+    request_init(&request, slot);
+    HIDL_PROBE3(binder_entry, request.slot, 1, key_value_pairs);
+    ret = transport->handler->set_parameters(&request, key_value_pairs, transport->user_data);
+    HIDL_PROBE5(binder_exit, request.slot, 1, key_value_pairs, ret, g_get_monotonic_time() - request.received);
+
+    return ret;
+}
+
+void
+hidl_transport_quit(
+        HidlTransport *transport)
+{
+    if (transport->handler->quit)
+        transport->handler->quit(transport->user_data);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * This application is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this application; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef __HIDL_TRANSPORT__
+#define __HIDL_TRANSPORT__
+
+#include <glib.h>
+
+/* Service side of the helper. A transport delivers IQcRilAudioCallback
+ * getParameters/setParameters requests of one or more slots to the
+ * handler. "binder" talks to the QCRIL audio services over hwbinder,
+ * "fake" generates requests itself for benchmarking on plain Linux. */
+
+typedef struct hidl_transport HidlTransport;
+typedef struct hidl_transport_slot HidlTransportSlot;
+typedef struct hidl_transport_driver HidlTransportDriver;
+
+/* One getParameters/setParameters call received by a transport. */
+typedef struct hidl_transport_request {
+    const char *slot;
+    /* Unique within the helper, correlates the stage timing of the
+     * request with the module. */
+    guint64 id;
+    /* g_get_monotonic_time() when the transport received the call. */
+    gint64 received;
+} HidlTransportRequest;
+
+typedef struct hidl_transport_handler {
+    /* getParameters(string) generates (string), returns FALSE on failure. */
+    gboolean (*get_parameters)(const HidlTransportRequest *request, const char *keys, gchar **reply_values,
+                               gpointer user_data);
+    /* setParameters(string) generates (int32_t) */
+    gint (*set_parameters)(const HidlTransportRequest *request, const char *key_value_pairs, gpointer user_data);
+    /* Transport has nothing more to do, helper should exit. */
+    void (*quit)(gpointer user_data);
+} HidlTransportHandler;
+
+struct hidl_transport {
+    const HidlTransportDriver *driver;
+    const HidlTransportHandler *handler;
+    gpointer user_data;
+};
+
+struct hidl_transport_slot {
+    HidlTransport *transport;
+    gchar *name;
+};
+
+struct hidl_transport_driver {
+    const char *name;
+    /* Optional command line options of the transport. */
+    GOptionGroup* (*option_group)(void);
+    /* Allocate transport, base struct is filled by caller. */
+    HidlTransport* (*new)(void);
+    /* Release transport resources, base struct is freed by caller. */
+    void (*free)(HidlTransport *transport);
+    /* Block until the transport is usable. */
+    gboolean (*wait)(HidlTransport *transport);
+    HidlTransportSlot* (*slot_new)(HidlTransport *transport, const char *name);
+    /* Start serving requests of the slot, following deaths and
+     * re-registrations of the remote end until freed. */
+    void (*slot_connect)(HidlTransportSlot *slot);
+    void (*slot_free)(HidlTransportSlot *slot);
+};
+
+extern const HidlTransportDriver hidl_transport_binder;
+extern const HidlTransportDriver hidl_transport_fake;
+
+const HidlTransportDriver*
+hidl_transport_find(
+        const char *name);
+
+void
+hidl_transport_add_option_groups(
+        GOptionContext *options);
+
+HidlTransport*
+hidl_transport_new(
+        const HidlTransportDriver *driver,
+        const HidlTransportHandler *handler,
+        gpointer user_data);
+
+void
+hidl_transport_free(
+        HidlTransport *transport);
+
+gboolean
+hidl_transport_wait(
+        HidlTransport *transport);
+
+HidlTransportSlot*
+hidl_transport_slot_new(
+        HidlTransport *transport,
+        const char *name);
+
+void
+hidl_transport_slot_connect(
+        HidlTransportSlot *slot);
+
+void
+hidl_transport_slot_free(
+        gpointer slot);
+
+/* For drivers, pass requests to the handler. */
+gboolean
+hidl_transport_slot_get_parameters(
+        HidlTransportSlot *slot,
+        const char *keys,
+        gchar **reply_values);
+
+gint
+hidl_transport_slot_set_parameters(
+        HidlTransportSlot *slot,
+        const char *key_value_pairs);
+
+void
+hidl_transport_quit(
+        HidlTransport *transport);
+
+#endif
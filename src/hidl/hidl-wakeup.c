@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * This application is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this application; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#include <time.h>
+
+#include "hidl-wakeup.h"
+
+static HidlWakeupStats wakeup_stats[HIDL_WAKEUP_SOURCES];
+
+static const char* const wakeup_names[HIDL_WAKEUP_SOURCES] = {
+    [HIDL_WAKEUP_BINDER] = "binder",
+    [HIDL_WAKEUP_DBUS] = "dbus",
+    [HIDL_WAKEUP_TIMER] = "timer",
+    [HIDL_WAKEUP_SIGNAL] = "signal",
+    [HIDL_WAKEUP_CONFIG] = "config"
+};
+
+static gint64
+cpu_usec(
+        clockid_t clock)
+{
+    struct timespec ts;
+
+    if (clock_gettime(clock, &ts) < 0)
+        return 0;
+
+    return (gint64) ts.tv_sec * G_USEC_PER_SEC + ts.tv_nsec / 1000;
+}
+
+gint64
+hidl_wakeup_begin(void)
+{
+    return cpu_usec(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void
+hidl_wakeup_end(
+        HidlWakeupSource source,
+        gint64 begin)
+{
+    g_return_if_fail(source < HIDL_WAKEUP_SOURCES);
+
+    wakeup_stats[source].count++;
+    wakeup_stats[source].cpu_usec += cpu_usec(CLOCK_THREAD_CPUTIME_ID) - begin;
+}
+
+const HidlWakeupStats*
+hidl_wakeup_stats(
+        HidlWakeupSource source)
+{
+    g_return_val_if_fail(source < HIDL_WAKEUP_SOURCES, NULL);
+
+    return &wakeup_stats[source];
+}
+
+const char*
+hidl_wakeup_source_name(
+        HidlWakeupSource source)
+{
+    g_return_val_if_fail(source < HIDL_WAKEUP_SOURCES, NULL);
+
+    return wakeup_names[source];
+}
+
+gint64
+hidl_wakeup_process_cpu_usec(void)
+{
+    return cpu_usec(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+/*
+ * Local Variables:
+ * mode: C
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
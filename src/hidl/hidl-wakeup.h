@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * This application is free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This application is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this application; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef __HIDL_WAKEUP__
+#define __HIDL_WAKEUP__
+
+#include <glib.h>
+
+/* Wakeup accounting of the helper main loop. Every callback the main loop
+ * dispatches is counted with the CPU time the main thread spent in it,
+ * per kind of event source. */
+
+typedef enum hidl_wakeup_source {
+    HIDL_WAKEUP_BINDER,
+    HIDL_WAKEUP_DBUS,
+    HIDL_WAKEUP_TIMER,
+    HIDL_WAKEUP_SIGNAL,
+    HIDL_WAKEUP_CONFIG,
+    HIDL_WAKEUP_SOURCES
+} HidlWakeupSource;
+
+typedef struct hidl_wakeup_stats {
+    guint64 count;
+    gint64 cpu_usec;
+} HidlWakeupStats;
+
+/* Returns begin mark to pass to hidl_wakeup_end(). */
+gint64
+hidl_wakeup_begin(void);
+
+void
+hidl_wakeup_end(
+        HidlWakeupSource source,
+        gint64 begin);
+
+const HidlWakeupStats*
+hidl_wakeup_stats(
+        HidlWakeupSource source);
+
+const char*
+hidl_wakeup_source_name(
+        HidlWakeupSource source);
+
+/* CPU time of the whole process, including GLib worker threads. */
+gint64
+hidl_wakeup_process_cpu_usec(void);
+
+#endif
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include <pulse/rtclock.h>
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/fdsem.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/log.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/poll.h>
+#include <pulsecore/thread.h>
+
+#include "hidl-watchdog.h"
+
+#define PAYLOAD_MAX         (128)
+#define ENTRIES_MAX         (64)
+
+struct hidl_watchdog {
+    pa_usec_t warn;
+
+    pa_thread *thread;
+    pa_mutex *mutex;
+    pa_cond *cond;
+    /* Posted when a call ends, wakes the thread sleeping on a deadline. */
+    pa_fdsem *fdsem;
+
+    /* Call in progress, protected by mutex. */
+    bool quit;
+    bool active;
+    bool wait_end;
+    uint64_t seq;
+    pa_usec_t begin;
+    /* Thread making the call. */
+    pid_t tid;
+    char payload[PAYLOAD_MAX];
+
+    /* Slow call counters, key (char *) -> hidl_watchdog_entry. Only
+     * touched by the calling thread. */
+    pa_hashmap *entries;
+};
+
+static void entry_free(hidl_watchdog_entry *e) {
+    pa_xfree((char *) e->key);
+    pa_xfree(e);
+}
+
+/* Scheduler state and wait channel of the calling thread, as in ps. */
+static void thread_state(hidl_watchdog *w, char *state, size_t size) {
+    char path[64];
+    char line[256];
+    char wchan[64] = "?";
+    char s = '?';
+    const char *e;
+    FILE *f;
+
+    pa_snprintf(path, sizeof(path), "/proc/self/task/%d/stat", (int) w->tid);
+    if ((f = fopen(path, "r"))) {
+        if (fgets(line, sizeof(line), f) && (e = strrchr(line, ')')) && e[1] == ' ')
+            s = e[2];
+        fclose(f);
+    }
+
+    pa_snprintf(path, sizeof(path), "/proc/self/task/%d/wchan", (int) w->tid);
+    if ((f = fopen(path, "r"))) {
+        if (!fgets(wchan, sizeof(wchan), f))
+            pa_snprintf(wchan, sizeof(wchan), "?");
+        fclose(f);
+    }
+
+    pa_snprintf(state, size, "%c wchan=%s", s, wchan);
+}
+
+static void log_blocked(hidl_watchdog *w) {
+    char state[96];
+
+    thread_state(w, state, sizeof(state));
+    pa_log_warn("HAL call \"%s\" blocked for %" PRIu64 " ms, thread %d state %s",
+                w->payload, (pa_rtclock_now() - w->begin) / PA_USEC_PER_MSEC, (int) w->tid, state);
+}
+
+/* Sleep until timeout has passed or fdsem is posted. */
+static void fdsem_timedwait(pa_fdsem *f, pa_usec_t timeout) {
+    struct pollfd pfd;
+
+    if (pa_fdsem_before_poll(f) < 0)
+        return;
+
+    pfd.fd = pa_fdsem_get(f);
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    pa_poll(&pfd, 1, (int) ((timeout + PA_USEC_PER_MSEC - 1) / PA_USEC_PER_MSEC));
+
+    pa_fdsem_after_poll(f);
+}
+
+/* Called and returns with mutex held. Returns true if call seq is still in
+ * progress at deadline. */
+static bool sleep_until(hidl_watchdog *w, uint64_t seq, pa_usec_t deadline) {
+    pa_usec_t now;
+
+    while (!w->quit && w->active && w->seq == seq) {
+        if ((now = pa_rtclock_now()) >= deadline)
+            return true;
+
+        pa_mutex_unlock(w->mutex);
+        fdsem_timedwait(w->fdsem, deadline - now);
+        pa_mutex_lock(w->mutex);
+    }
+
+    return false;
+}
+
+static void watch_call(hidl_watchdog *w, uint64_t seq) {
+    if (sleep_until(w, seq, w->begin + w->warn))
+        log_blocked(w);
+}
+
+static void thread_func(void *userdata) {
+    hidl_watchdog *w = userdata;
+    uint64_t seq;
+
+    pa_mutex_lock(w->mutex);
+
+    for (;;) {
+        while (!w->quit && !w->active)
+            pa_cond_wait(w->cond, w->mutex);
+
+        if (w->quit)
+            break;
+
+        seq = w->seq;
+        watch_call(w, seq);
+
+        /* Nothing more to do for this call, wait for it to end. */
+        w->wait_end = true;
+        while (!w->quit && w->active && w->seq == seq)
+            pa_cond_wait(w->cond, w->mutex);
+        w->wait_end = false;
+    }
+
+    pa_mutex_unlock(w->mutex);
+}
+
+static void count_slow(hidl_watchdog *w, const char *payload, pa_usec_t usec) {
+    hidl_watchdog_entry *e;
+    const char *state = NULL;
+    char *key;
+    char *value;
+
+    while ((key = pa_split(payload, ";", &state))) {
+        if ((value = strchr(key, '=')))
+            *value = '\0';
+
+        if (!(e = pa_hashmap_get(w->entries, key))) {
+            if (pa_hashmap_size(w->entries) >= ENTRIES_MAX) {
+                pa_xfree(key);
+                continue;
+            }
+
+            e = pa_xnew0(hidl_watchdog_entry, 1);
+            e->key = key;
+            pa_hashmap_put(w->entries, (void *) e->key, e);
+        } else
+            pa_xfree(key);
+
+        e->slow++;
+        if (usec > e->max_usec)
+            e->max_usec = usec;
+    }
+}
+
+hidl_watchdog *hidl_watchdog_new(pa_usec_t warn) {
+    hidl_watchdog *w;
+
+    pa_assert(warn > 0);
+
+    w = pa_xnew0(hidl_watchdog, 1);
+    w->warn = warn;
+    w->mutex = pa_mutex_new(false, false);
+    w->cond = pa_cond_new();
+    w->fdsem = pa_fdsem_new();
+    w->entries = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                     NULL, (pa_free_cb_t) entry_free);
+
+    if (!(w->thread = pa_thread_new("hidl-watchdog", thread_func, w))) {
+        pa_log("Failed to start HAL watchdog thread.");
+        hidl_watchdog_free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+void hidl_watchdog_free(hidl_watchdog *w) {
+    pa_assert(w);
+
+    if (w->thread) {
+        pa_mutex_lock(w->mutex);
+        w->quit = true;
+        pa_cond_signal(w->cond, 0);
+        pa_mutex_unlock(w->mutex);
+        pa_fdsem_post(w->fdsem);
+        pa_thread_free(w->thread);
+    }
+
+    pa_hashmap_free(w->entries);
+    pa_fdsem_free(w->fdsem);
+    pa_cond_free(w->cond);
+    pa_mutex_free(w->mutex);
+    pa_xfree(w);
+}
+
+void hidl_watchdog_begin(hidl_watchdog *w, const char *payload) {
+    pid_t tid = (pid_t) syscall(SYS_gettid);
+
+    pa_assert(w);
+    pa_assert(payload);
+
+    pa_mutex_lock(w->mutex);
+    w->seq++;
+    w->begin = pa_rtclock_now();
+    w->tid = tid;
+    pa_strlcpy(w->payload, payload, sizeof(w->payload));
+    w->active = true;
+    pa_cond_signal(w->cond, 0);
+    pa_mutex_unlock(w->mutex);
+}
+
+void hidl_watchdog_end(hidl_watchdog *w) {
+    pa_usec_t usec;
+
+    pa_assert(w);
+
+    pa_mutex_lock(w->mutex);
+    w->active = false;
+    usec = pa_rtclock_now() - w->begin;
+    if (w->wait_end)
+        pa_cond_signal(w->cond, 0);
+    pa_mutex_unlock(w->mutex);
+    pa_fdsem_post(w->fdsem);
+
+    if (usec >= w->warn) {
+        pa_log_warn("HAL call \"%s\" returned after %" PRIu64 " ms", w->payload, usec / PA_USEC_PER_MSEC);
+        count_slow(w, w->payload, usec);
+    }
+}
+
+const hidl_watchdog_entry *hidl_watchdog_iterate(hidl_watchdog *w, void **state) {
+    pa_assert(w);
+    pa_assert(state);
+
+    return pa_hashmap_iterate(w->entries, state, NULL);
+}
+
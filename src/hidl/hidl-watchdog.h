@@ -0,0 +1,56 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foohidlwatchdogfoo
+#define foohidlwatchdogfoo
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pulse/sample.h>
+
+/* Watchdog for blocking HAL calls.
+ *
+ * HAL calls are made from the main thread with the hw module lock held,
+ * so a vendor implementation blocking in get_parameters or
+ * set_parameters stalls audio. A separate thread watches the call in
+ * progress: past the warning threshold it logs the payload, the elapsed
+ * time and the state of the calling thread. The watchdog thread does
+ * nothing else, the call can't be interrupted and its caller is answered
+ * with its result when it returns. Slow calls are counted per key. */
+
+typedef struct hidl_watchdog hidl_watchdog;
+
+typedef struct hidl_watchdog_entry {
+    const char *key;
+    uint64_t slow;
+    pa_usec_t max_usec;
+} hidl_watchdog_entry;
+
+hidl_watchdog *hidl_watchdog_new(pa_usec_t warn);
+void hidl_watchdog_free(hidl_watchdog *w);
+
+void hidl_watchdog_begin(hidl_watchdog *w, const char *payload);
+void hidl_watchdog_end(hidl_watchdog *w);
+
+/* Iterate slow call counters, state initialized to NULL. Returns NULL
+ * when done. */
+const hidl_watchdog_entry *hidl_watchdog_iterate(hidl_watchdog *w, void **state);
+
+#endif
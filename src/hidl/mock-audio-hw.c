@@ -0,0 +1,251 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <pulse/timeval.h>
+#include <pulse/xmalloc.h>
+
+#include <pulsecore/core-util.h>
+#include <pulsecore/hashmap.h>
+#include <pulsecore/llist.h>
+#include <pulsecore/macro.h>
+#include <pulsecore/mutex.h>
+#include <pulsecore/strbuf.h>
+
+#include <droid/droid-util.h>
+
+#include "mock-audio-hw.h"
+
+struct mock_audio_hw {
+    /* Must be first, the HAL functions get a pointer to device. */
+    struct audio_hw_device device;
+    pa_droid_hw_module hw_module;
+
+    char *module_id;
+    pa_mutex *mutex;
+    pa_hashmap *values;
+    pa_usec_t get_latency;
+    pa_usec_t set_latency;
+    int set_result;
+
+    unsigned calls[2];
+    mock_audio_hw_call log[MOCK_AUDIO_HW_CALL_LOG];
+    unsigned log_index;
+    unsigned log_count;
+
+    PA_LLIST_FIELDS(mock_audio_hw);
+};
+
+static PA_LLIST_HEAD(mock_audio_hw, mocks) = NULL;
+
+static mock_audio_hw *mock_from_hw_module(pa_droid_hw_module *hw) {
+    return (mock_audio_hw *) ((uint8_t *) hw - offsetof(mock_audio_hw, hw_module));
+}
+
+static void mock_delay(pa_usec_t usec) {
+    struct timespec ts;
+
+    if (usec == 0)
+        return;
+
+    ts.tv_sec = usec / PA_USEC_PER_SEC;
+    ts.tv_nsec = (usec % PA_USEC_PER_SEC) * PA_NSEC_PER_USEC;
+
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+}
+
+static void mock_record(mock_audio_hw *m, mock_audio_hw_op_t op, const char *payload, int ret) {
+    mock_audio_hw_call *call;
+
+    m->calls[op]++;
+
+    call = &m->log[m->log_index];
+    pa_xfree(call->payload);
+    call->op = op;
+    call->payload = pa_xstrdup(payload);
+    call->ret = ret;
+
+    m->log_index = (m->log_index + 1) % MOCK_AUDIO_HW_CALL_LOG;
+    if (m->log_count < MOCK_AUDIO_HW_CALL_LOG)
+        m->log_count++;
+}
+
+static char *mock_get_parameters(const struct audio_hw_device *dev, const char *keys) {
+    mock_audio_hw *m = (mock_audio_hw *) dev;
+    pa_strbuf *buf;
+    const char *state = NULL;
+    const char *value;
+    char *key;
+    char *pa_reply;
+    char *reply;
+
+    mock_delay(m->get_latency);
+
+    buf = pa_strbuf_new();
+    while ((key = pa_split(keys, ";", &state))) {
+        if ((value = pa_hashmap_get(m->values, key)))
+            pa_strbuf_printf(buf, "%s%s=%s", pa_strbuf_isempty(buf) ? "" : ";", key, value);
+        pa_xfree(key);
+    }
+
+    mock_record(m, MOCK_AUDIO_HW_GET, keys, 0);
+
+    /* Like a real HAL, the reply is allocated with malloc(). */
+    pa_reply = pa_strbuf_to_string_free(buf);
+    reply = strdup(pa_reply);
+    pa_xfree(pa_reply);
+
+    return reply;
+}
+
+static int mock_set_parameters(struct audio_hw_device *dev, const char *kv_pairs) {
+    mock_audio_hw *m = (mock_audio_hw *) dev;
+    const char *state = NULL;
+    char *pair;
+    char *value;
+
+    mock_delay(m->set_latency);
+
+    if (m->set_result == 0) {
+        while ((pair = pa_split(kv_pairs, ";", &state))) {
+            if ((value = strchr(pair, '='))) {
+                *value++ = '\0';
+                mock_audio_hw_set_value(m, pair, value);
+            }
+            pa_xfree(pair);
+        }
+    }
+
+    mock_record(m, MOCK_AUDIO_HW_SET, kv_pairs, m->set_result);
+
+    return m->set_result;
+}
+
+mock_audio_hw *mock_audio_hw_new(const char *module_id) {
+    mock_audio_hw *m;
+
+    pa_assert(module_id);
+
+    m = pa_xnew0(mock_audio_hw, 1);
+    m->device.get_parameters = mock_get_parameters;
+    m->device.set_parameters = mock_set_parameters;
+    m->hw_module.device = &m->device;
+    m->module_id = pa_xstrdup(module_id);
+    m->mutex = pa_mutex_new(true, false);
+    m->values = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                    pa_xfree, pa_xfree);
+
+    PA_LLIST_PREPEND(mock_audio_hw, mocks, m);
+
+    return m;
+}
+
+void mock_audio_hw_free(mock_audio_hw *m) {
+    unsigned i;
+
+    pa_assert(m);
+
+    PA_LLIST_REMOVE(mock_audio_hw, mocks, m);
+
+    for (i = 0; i < MOCK_AUDIO_HW_CALL_LOG; i++)
+        pa_xfree(m->log[i].payload);
+
+    pa_hashmap_free(m->values);
+    pa_mutex_free(m->mutex);
+    pa_xfree(m->module_id);
+    pa_xfree(m);
+}
+
+void mock_audio_hw_set_latency(mock_audio_hw *m, pa_usec_t get_latency, pa_usec_t set_latency) {
+    pa_assert(m);
+
+    m->get_latency = get_latency;
+    m->set_latency = set_latency;
+}
+
+void mock_audio_hw_set_result(mock_audio_hw *m, int ret) {
+    pa_assert(m);
+
+    m->set_result = ret;
+}
+
+void mock_audio_hw_set_value(mock_audio_hw *m, const char *key, const char *value) {
+    pa_assert(m);
+    pa_assert(key);
+    pa_assert(value);
+
+    pa_hashmap_remove_and_free(m->values, key);
+    pa_hashmap_put(m->values, pa_xstrdup(key), pa_xstrdup(value));
+}
+
+unsigned mock_audio_hw_calls(mock_audio_hw *m, mock_audio_hw_op_t op) {
+    pa_assert(m);
+
+    return m->calls[op];
+}
+
+unsigned mock_audio_hw_call_log(mock_audio_hw *m, const mock_audio_hw_call **calls, unsigned n) {
+    unsigned first;
+    unsigned i;
+
+    pa_assert(m);
+    pa_assert(calls);
+
+    n = PA_MIN(n, m->log_count);
+    first = (m->log_index + MOCK_AUDIO_HW_CALL_LOG - n) % MOCK_AUDIO_HW_CALL_LOG;
+
+    for (i = 0; i < n; i++)
+        calls[i] = &m->log[(first + i) % MOCK_AUDIO_HW_CALL_LOG];
+
+    return n;
+}
+
+/* libdroid-util replacements */
+
+pa_droid_hw_module *pa_droid_hw_module_get(pa_core *core, pa_droid_config_audio *config, const char *module_id) {
+    mock_audio_hw *m;
+
+    PA_LLIST_FOREACH(m, mocks) {
+        if (pa_streq(m->module_id, module_id))
+            return &m->hw_module;
+    }
+
+    return NULL;
+}
+
+void pa_droid_hw_module_unref(pa_droid_hw_module *hw) {
+}
+
+void pa_droid_hw_module_lock(pa_droid_hw_module *hw) {
+    pa_mutex_lock(mock_from_hw_module(hw)->mutex);
+}
+
+void pa_droid_hw_module_unlock(pa_droid_hw_module *hw) {
+    pa_mutex_unlock(mock_from_hw_module(hw)->mutex);
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026 pulseaudio-modules-droid-hidl contributors
+ *
+ * These PulseAudio Modules are free software; you can redistribute
+ * it and/or modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation
+ * version 2.1 of the License.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301
+ * USA.
+ */
+
+#ifndef foomockaudiohwfoo
+#define foomockaudiohwfoo
+
+#include <pulse/sample.h>
+
+/* Fake audio_hw_device for benchmarking without a device.
+ *
+ * Linking this in place of libdroid-util provides pa_droid_hw_module_get()
+ * and friends, returning hw modules registered with mock_audio_hw_new().
+ * The fake device answers get_parameters() for keys that have been set,
+ * simulates HAL latency and records the calls made to it. */
+
+#define MOCK_AUDIO_HW_CALL_LOG  (16)
+
+typedef struct mock_audio_hw mock_audio_hw;
+
+typedef enum mock_audio_hw_op {
+    MOCK_AUDIO_HW_GET,
+    MOCK_AUDIO_HW_SET
+} mock_audio_hw_op_t;
+
+typedef struct mock_audio_hw_call {
+    mock_audio_hw_op_t op;
+    char *payload;
+    int ret;
+} mock_audio_hw_call;
+
+mock_audio_hw *mock_audio_hw_new(const char *module_id);
+void mock_audio_hw_free(mock_audio_hw *m);
+
+void mock_audio_hw_set_latency(mock_audio_hw *m, pa_usec_t get_latency, pa_usec_t set_latency);
+/* Make set_parameters() return ret instead of storing the values. */
+void mock_audio_hw_set_result(mock_audio_hw *m, int ret);
+void mock_audio_hw_set_value(mock_audio_hw *m, const char *key, const char *value);
+
+unsigned mock_audio_hw_calls(mock_audio_hw *m, mock_audio_hw_op_t op);
+/* Recorded calls, most recent last. Returns number of calls in log. */
+unsigned mock_audio_hw_call_log(mock_audio_hw *m, const mock_audio_hw_call **calls, unsigned n);
+
+#endif
@@ -23,6 +23,8 @@
 #include <config.h>
 #endif
 
+#include <fnmatch.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <stdio.h>
 #include <dlfcn.h>
@@ -38,20 +40,39 @@
 #include <pulse/xmalloc.h>
 #include <pulse/mainloop-api.h>
 
+#include <pulsecore/asyncmsgq.h>
+#include <pulsecore/atomic.h>
 #include <pulsecore/core.h>
 #include <pulsecore/core-error.h>
+#include <pulsecore/core-util.h>
+#include <pulsecore/fdsem.h>
 #include <pulsecore/i18n.h>
+#include <pulsecore/llist.h>
 #include <pulsecore/module.h>
 #include <pulsecore/modargs.h>
 #include <pulsecore/log.h>
 #include <pulsecore/macro.h>
+#include <pulsecore/msgobject.h>
+#include <pulsecore/namereg.h>
 #include <pulsecore/protocol-dbus.h>
+#include <pulsecore/queue.h>
+#include <pulsecore/rtpoll.h>
+#include <pulsecore/sink.h>
+#include <pulsecore/source.h>
 #include <pulsecore/dbus-util.h>
 #include <pulsecore/start-child.h>
-
-#include <droid/droid-util.h>
+#include <pulsecore/strbuf.h>
 
 #include "common.h"
+#include "droid-hidl.h"
+#include "hidl-flight.h"
+#include "hidl-ofono.h"
+#include "hidl-passthrough.h"
+#include "hidl-admission.h"
+#include "hidl-defer.h"
+#include "hidl-probes.h"
+#include "hidl-sched.h"
+#include "hidl-trace.h"
 #include "module-droid-hidl-symdef.h"
 
 PA_MODULE_AUTHOR("Juho Hämäläinen");
@@ -59,31 +80,282 @@ PA_MODULE_DESCRIPTION("Droid HIDL passthrough");
 PA_MODULE_VERSION(PACKAGE_VERSION);
 PA_MODULE_USAGE(
         "module_id=<which droid hw module to load, default primary> "
-        "helper=<spawn helper binary, default true>"
+        "module_ids=<comma separated hw modules to serve, overrides module_id> "
+        "key_routes=<module_id>:<key pattern>[,<key pattern>...][;<module_id>:...] "
+        "helper=<spawn helper binary, default true> "
+        "negative_cache=<remember keys the HAL doesn't answer, default false> "
+        "negative_cache_ttl=<seconds after which unanswered keys are asked again, default 60> "
+        "probe_keys=<semicolon separated keys to probe at load, requires negative_cache> "
+        "restore_keys=<semicolon separated keys to persist and restore on load> "
+        "state_file=<file for persisted parameter state, default in runtime directory> "
+        "lazy_attach=<load without hw module and attach when it appears, default false> "
+        "pending_timeout=<msec requests wait for hw module to appear, 0 rejects immediately, default 1000> "
+        "stats_size=<number of keys to keep traffic statistics of, 0 disables, default 32> "
+        "state_size=<number of keys to track latest values of for query_parameters, 0 disables, default 256> "
+        "query_max_age=<msec after which query_parameters refreshes a value from the HAL, default 1000> "
+        "capture_file=<file to capture passthrough traffic to for hidl-replay> "
+        "hal_warn=<msec after which a blocked HAL call is logged, 0 disables HAL watchdog, default 0> "
+        "flight_size=<number of recent requests to keep in flight recorder, 0 disables, default 64> "
+        "flight_deadline=<msec after which a request dumps the flight recorder to log, 0 disables, default 1000> "
+        "trace_size=<number of traced requests to keep stage timing of, 0 disables, default 64> "
+        "helper_watchdog=<msec without helper heartbeat before restarting it, 0 disables, default 30000> "
+        "optimistic_keys=<key pattern>[,<key pattern>...] (setParameters the helper acknowledges before applying) "
+        "priority=<high|normal|low>:<key pattern|@helper>[,...][;...] (enables request scheduling by priority) "
+        "priority_aging=<msec after which a queued request runs before higher priority ones, default 100> "
+        "client_rate=<requests per second a D-Bus client may make, default 0 (unlimited)> "
+        "client_burst=<requests a D-Bus client may make at once with client_rate, default 20> "
+        "max_queued=<requests queued in the module before rejecting more, default 0 (unlimited)> "
+        "io_thread_sink=<sink after whose writes setParameters are applied while it is running> "
+        "io_thread_keys=<key pattern>[,<key pattern>...] (setParameters timed by io_thread_sink writes, default all) "
+        "defer_keys=<key pattern>[,<key pattern>...] (setParameters held back while droid sinks and sources are suspended) "
+        "urgent_keys=<key pattern>[,<key pattern>...] (keys never held back)"
 );
 
 static const char* const valid_modargs[] = {
     "module_id",
+    "module_ids",
+    "key_routes",
     "helper",
+    "negative_cache",
+    "negative_cache_ttl",
+    "probe_keys",
+    "restore_keys",
+    "state_file",
+    "lazy_attach",
+    "pending_timeout",
+    "stats_size",
+    "state_size",
+    "query_max_age",
+    "capture_file",
+    "hal_warn",
+    "flight_size",
+    "flight_deadline",
+    "trace_size",
+    "helper_watchdog",
+    "optimistic_keys",
+    "priority",
+    "priority_aging",
+    "client_rate",
+    "client_burst",
+    "max_queued",
+    "io_thread_sink",
+    "io_thread_keys",
+    "defer_keys",
+    "urgent_keys",
     NULL,
 };
 
-#define DEFAULT_MODULE_ID   "primary"
-
 #define HELPER_BINARY       HIDL_HELPER_LOCATION "/" HELPER_NAME
 #define BUFFER_MAX          (512)
+/* Longer helper output without a newline is logged as it is. */
+#define HELPER_LINE_MAX     (4096)
+/* Reaping a helper that closed its output. */
+#define HELPER_REAP_INTERVAL    (100 * PA_USEC_PER_MSEC)
+#define HELPER_REAP_TRIES       (10)
+/* Restart backoff of a helper that died or failed to start. */
+#define HELPER_RESTART_MIN      (1 * PA_USEC_PER_SEC)
+#define HELPER_RESTART_MAX      (60 * PA_USEC_PER_SEC)
+#define PENDING_MAX         (64)
+#define DEFAULT_PENDING_TIMEOUT_MS  (1000)
+#define DEFAULT_FLIGHT_SIZE         (64)
+#define DEFAULT_FLIGHT_DEADLINE_MS  (1000)
+#define FLIGHT_DUMP_INTERVAL        (10 * PA_USEC_PER_SEC)
+#define DEFAULT_TRACE_SIZE          (64)
+#define DEFAULT_HELPER_WATCHDOG_MS  (30000)
+#define DEFAULT_PRIORITY_AGING_MS   (100)
+#define DEFAULT_CLIENT_RATE         (0)
+#define DEFAULT_CLIENT_BURST        (20)
+#define DEFAULT_MAX_QUEUED          (0)
+#define DEFAULT_QUERY_MAX_AGE_MS    (1000)
+
+/* Flight recorder stages of the module. */
+enum flight_stage {
+    FLIGHT_RECEIVED,
+    FLIGHT_HAL_BEGIN,
+    FLIGHT_HAL_END,
+    FLIGHT_REPLIED
+};
+
+/* Identity and helper stage times of a request made with a *_traced
+ * method. */
+struct request_trace {
+    dbus_uint64_t boot_id;
+    dbus_uint64_t id;
+    const char *slot;
+    dbus_uint64_t binder_received;
+    dbus_uint64_t dbus_sent;
+};
+
+/* get or set request queued in the priority scheduler or behind a
+ * setParameters waiting for io_thread_sink. Strings point to msg. */
+struct queued_request {
+    DBusConnection *conn;
+    DBusMessage *msg;
+    bool set;
+    const char *payload;
+    bool traced;
+    struct request_trace trace;
+    pa_usec_t received;
+};
+
+/* Longer than a sink period, after this a waiting setParameters is applied
+ * without a write having completed. */
+#define IO_SYNC_TIMEOUT             (100 * PA_USEC_PER_MSEC)
+
+/* Times setParameters by the writes of io_thread_sink. The droid sink
+ * renders and writes a period when its rtpoll timer elapses, so the first
+ * rtpoll iteration after a timer wakeup starts right after the write.
+ * While a setParameters waits, an rtpoll item in the sink IO thread
+ * watches for that and posts fdsem, which the main loop watches. The
+ * request is then applied and answered from the main loop, and requests
+ * arriving meanwhile queue behind it to stay in order. */
+struct io_sync {
+    pa_msgobject parent;
+
+    pa_fdsem *fdsem;
+    pa_io_event *io_event;
+    /* Generation of the last wait that saw a write. */
+    pa_atomic_t written;
+
+    /* Waiting request, NULL if none, and requests queued behind it. */
+    struct queued_request *request;
+    pa_queue *queue;
+    int generation;
+    struct io_watch *watch;
+    pa_time_event *timeout_event;
+
+    /* Last sink messages were posted to, until it is unlinked. */
+    pa_sink *sink;
+    pa_hook_slot *unlink_slot;
+};
+
+/* Watch of one wait. Allocated by the main thread, the IO thread of sink
+ * owns it between IO_SYNC_ARM and IO_SYNC_DISARM. */
+struct io_watch {
+    struct io_sync *y;
+    pa_sink *sink;
+    int generation;
+
+    /* IO thread only. */
+    pa_rtpoll *rtpoll;
+    pa_rtpoll_item *item;
+    bool timer_elapsed;
+    bool posted;
+};
+
+typedef struct io_sync io_sync;
+PA_DEFINE_PRIVATE_CLASS(io_sync, pa_msgobject);
+
+enum {
+    IO_SYNC_ARM,
+    IO_SYNC_DISARM
+};
+
+struct pa_droid_hidl_subscription {
+    pa_droid_hidl_changed_cb_t cb;
+    void *userdata;
+    PA_LLIST_FIELDS(pa_droid_hidl_subscription);
+};
+
+/* In-process API registered in pa_shared. */
+struct api {
+    pa_droid_hidl_api public;
+    struct userdata *u;
+};
+
+/* D-Bus method call waiting for hw module to appear. */
+struct pending_request {
+    DBusConnection *conn;
+    DBusMessage *msg;
+    pa_dbus_receive_cb_t receive_cb;
+    pa_usec_t deadline;
+
+    PA_LLIST_FIELDS(struct pending_request);
+};
 
 struct userdata {
     pa_core *core;
     pa_module *module;
 
     pa_dbus_protocol* dbus_protocol;
-    pa_droid_hw_module *hw_module;
+    hidl_passthrough *passthrough;
+
+    /* Lazy attach */
+    pa_usec_t pending_timeout;
+    unsigned n_pending;
+    PA_LLIST_HEAD(struct pending_request, pending);
+    struct pending_request *pending_tail;
+    pa_time_event *pending_event;
+    pa_defer_event *attach_event;
+    pa_hook_slot *card_put_slot;
+    pa_hook_slot *sink_put_slot;
+    pa_hook_slot *source_put_slot;
+
+    /* Flight recorder, entries NULL if disabled. */
+    struct hidl_flight flight;
+    struct hidl_flight_entry *flight_entries;
+    pa_usec_t flight_deadline;
+    pa_usec_t flight_dumped;
+
+    /* Stage timing of traced requests, NULL if disabled. */
+    hidl_trace *trace;
+
+    /* Priority scheduling of requests, NULL if disabled. */
+    hidl_sched *sched;
+    unsigned n_queued;
+
+    /* Admission control of D-Bus clients, client of a connection is
+     * stored in connection data slot. */
+    hidl_admission *admission;
+    dbus_int32_t client_slot;
+    bool replaying;
+
+    /* setParameters applied after writes of io_thread_sink, NULL if
+     * disabled. */
+    io_sync *io_sync;
+    char *io_thread_sink;
+    char *io_thread_keys;
+
+    /* setParameters held back while droid sinks and sources are
+     * suspended, NULL if disabled. */
+    hidl_defer *defer;
+    bool suspended;
+    pa_defer_event *suspend_event;
+    pa_hook_slot *suspend_slots[6];
+
+    /* Values older than this are refreshed by query_parameters. */
+    pa_usec_t query_max_age;
+
+    /* In-process API, NULL if not registered. */
+    struct api *api;
+    PA_LLIST_HEAD(pa_droid_hidl_subscription, subscriptions);
 
     /* Helper */
+    char *dbus_address;
+    char *optimistic_keys;
     pid_t pid;
     int fd;
     pa_io_event *io_event;
+    /* Helper output after the last complete line. */
+    char *output;
+    /* Helper closed its output, waiting for it to exit. */
+    pa_time_event *reap_event;
+    unsigned reap_tries;
+    /* Restart of a helper that died or failed to start. */
+    pa_time_event *restart_event;
+    pa_usec_t restart_delay;
+    pa_usec_t start_time;
+
+    /* Watches oFono configuration while there are no binder slots for the
+     * helper to serve. */
+    hidl_ofono_watch *ofono_watch;
+
+    /* Helper watchdog, armed by the first heartbeat. Restarts a hung
+     * helper, dead ones are restarted by helper_gone(). */
+    pa_usec_t helper_watchdog;
+    pa_time_event *watchdog_event;
+    pa_usec_t heartbeat_time;
+    char *heartbeat;
 };
 
 static pa_log_level_t _log_level = PA_LOG_ERROR;
@@ -96,10 +368,38 @@ static bool log_level_debug(void) {
 
 static void hidl_get_parameters(DBusConnection *conn, DBusMessage *msg, void *userdata);
 static void hidl_set_parameters(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_statistics(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_dump_flight_recorder(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_parameters_traced(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_set_parameters_traced(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_report_trace(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_traces(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_trace_size(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_slow_hal_calls(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_optimistic_keys(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_priority_stats(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_client_stats(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_query_parameters(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void hidl_get_helper_wakeups(DBusConnection *conn, DBusMessage *msg, void *userdata);
+static void pending_add(struct userdata *u, DBusConnection *conn, DBusMessage *msg, pa_dbus_receive_cb_t receive_cb);
+static void request_exec(struct userdata *u, struct queued_request *q);
 
 enum hidl_passthrough_methods {
     HIDL_PASSTHROUGH_GET_PARAMETERS,
     HIDL_PASSTHROUGH_SET_PARAMETERS,
+    HIDL_PASSTHROUGH_GET_STATISTICS,
+    HIDL_PASSTHROUGH_DUMP_FLIGHT_RECORDER,
+    HIDL_PASSTHROUGH_GET_PARAMETERS_TRACED,
+    HIDL_PASSTHROUGH_SET_PARAMETERS_TRACED,
+    HIDL_PASSTHROUGH_REPORT_TRACE,
+    HIDL_PASSTHROUGH_GET_TRACES,
+    HIDL_PASSTHROUGH_GET_SLOW_HAL_CALLS,
+    HIDL_PASSTHROUGH_GET_OPTIMISTIC_KEYS,
+    HIDL_PASSTHROUGH_GET_PRIORITY_STATS,
+    HIDL_PASSTHROUGH_GET_CLIENT_STATS,
+    HIDL_PASSTHROUGH_QUERY_PARAMETERS,
+    HIDL_PASSTHROUGH_GET_HELPER_WAKEUPS,
+    HIDL_PASSTHROUGH_GET_TRACE_SIZE,
     HIDL_PASSTHROUGH_METHOD_MAX
 };
 
@@ -111,6 +411,78 @@ static pa_dbus_arg_info set_parameters_args[] = {
     { "key_value_pairs", "s", "in" }
 };
 
+/* key, count, count error, reads, writes, redundant writes, HAL time in usec */
+static pa_dbus_arg_info get_statistics_args[] = {
+    { "statistics", "a" HIDL_STATS_ENTRY_SIGNATURE, "out" }
+};
+
+static pa_dbus_arg_info dump_flight_recorder_args[] = {
+    { "dump", "s", "out" }
+};
+
+static pa_dbus_arg_info get_parameters_traced_args[] = {
+    { "boot_id", "t", "in" },
+    { "id", "t", "in" },
+    { "slot", "s", "in" },
+    { "binder_received", "t", "in" },
+    { "dbus_sent", "t", "in" },
+    { "keys", "s", "in" }
+};
+
+static pa_dbus_arg_info set_parameters_traced_args[] = {
+    { "boot_id", "t", "in" },
+    { "id", "t", "in" },
+    { "slot", "s", "in" },
+    { "binder_received", "t", "in" },
+    { "dbus_sent", "t", "in" },
+    { "key_value_pairs", "s", "in" }
+};
+
+static pa_dbus_arg_info report_trace_args[] = {
+    { "boot_id", "t", "in" },
+    { "id", "t", "in" },
+    { "binder_replied", "t", "in" }
+};
+
+/* id, slot, set, payload, result and times of enum hidl_trace_stage */
+static pa_dbus_arg_info get_traces_args[] = {
+    { "traces", "a(tsbsittttttt)", "out" }
+};
+
+/* key, slow calls, longest call in usec */
+static pa_dbus_arg_info get_slow_hal_calls_args[] = {
+    { "calls", "a(stt)", "out" }
+};
+
+static pa_dbus_arg_info get_optimistic_keys_args[] = {
+    { "keys", "s", "out" }
+};
+
+/* class, requests, total and longest queueing delay in usec */
+static pa_dbus_arg_info get_priority_stats_args[] = {
+    { "classes", "a(sttt)", "out" }
+};
+
+/* client, exempt, accepted, rejected by rate limit, rejected by queue limit */
+static pa_dbus_arg_info get_client_stats_args[] = {
+    { "clients", "a(sbttt)", "out" }
+};
+
+static pa_dbus_arg_info query_parameters_args[] = {
+    { "pattern", "s", "in" },
+    { "refresh", "b", "in" },
+    { "key_value_pairs", "s", "out" }
+};
+
+/* event source, wakeups, helper main thread CPU time in usec */
+static pa_dbus_arg_info get_helper_wakeups_args[] = {
+    { "wakeups", "a(stt)", "out" }
+};
+
+static pa_dbus_arg_info get_trace_size_args[] = {
+    { "size", "u", "out" }
+};
+
 static pa_dbus_method_handler hidl_passthrough_method_handlers[HIDL_PASSTHROUGH_METHOD_MAX] = {
     [HIDL_PASSTHROUGH_GET_PARAMETERS] = {
         .method_name = HIDL_PASSTHROUGH_METHOD_GET_PARAMETERS,
@@ -124,6 +496,84 @@ static pa_dbus_method_handler hidl_passthrough_method_handlers[HIDL_PASSTHROUGH_
         .n_arguments = sizeof(set_parameters_args) / sizeof(set_parameters_args[0]),
         .receive_cb = hidl_set_parameters
     },
+    [HIDL_PASSTHROUGH_GET_STATISTICS] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_STATISTICS,
+        .arguments = get_statistics_args,
+        .n_arguments = sizeof(get_statistics_args) / sizeof(get_statistics_args[0]),
+        .receive_cb = hidl_get_statistics
+    },
+    [HIDL_PASSTHROUGH_DUMP_FLIGHT_RECORDER] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_DUMP_FLIGHT_RECORDER,
+        .arguments = dump_flight_recorder_args,
+        .n_arguments = sizeof(dump_flight_recorder_args) / sizeof(dump_flight_recorder_args[0]),
+        .receive_cb = hidl_dump_flight_recorder
+    },
+    [HIDL_PASSTHROUGH_GET_PARAMETERS_TRACED] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_PARAMETERS_TRACED,
+        .arguments = get_parameters_traced_args,
+        .n_arguments = sizeof(get_parameters_traced_args) / sizeof(get_parameters_traced_args[0]),
+        .receive_cb = hidl_get_parameters_traced
+    },
+    [HIDL_PASSTHROUGH_SET_PARAMETERS_TRACED] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_SET_PARAMETERS_TRACED,
+        .arguments = set_parameters_traced_args,
+        .n_arguments = sizeof(set_parameters_traced_args) / sizeof(set_parameters_traced_args[0]),
+        .receive_cb = hidl_set_parameters_traced
+    },
+    [HIDL_PASSTHROUGH_REPORT_TRACE] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_REPORT_TRACE,
+        .arguments = report_trace_args,
+        .n_arguments = sizeof(report_trace_args) / sizeof(report_trace_args[0]),
+        .receive_cb = hidl_report_trace
+    },
+    [HIDL_PASSTHROUGH_GET_TRACES] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_TRACES,
+        .arguments = get_traces_args,
+        .n_arguments = sizeof(get_traces_args) / sizeof(get_traces_args[0]),
+        .receive_cb = hidl_get_traces
+    },
+    [HIDL_PASSTHROUGH_GET_SLOW_HAL_CALLS] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_SLOW_HAL_CALLS,
+        .arguments = get_slow_hal_calls_args,
+        .n_arguments = sizeof(get_slow_hal_calls_args) / sizeof(get_slow_hal_calls_args[0]),
+        .receive_cb = hidl_get_slow_hal_calls
+    },
+    [HIDL_PASSTHROUGH_GET_OPTIMISTIC_KEYS] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_OPTIMISTIC_KEYS,
+        .arguments = get_optimistic_keys_args,
+        .n_arguments = sizeof(get_optimistic_keys_args) / sizeof(get_optimistic_keys_args[0]),
+        .receive_cb = hidl_get_optimistic_keys
+    },
+    [HIDL_PASSTHROUGH_GET_PRIORITY_STATS] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_PRIORITY_STATS,
+        .arguments = get_priority_stats_args,
+        .n_arguments = sizeof(get_priority_stats_args) / sizeof(get_priority_stats_args[0]),
+        .receive_cb = hidl_get_priority_stats
+    },
+    [HIDL_PASSTHROUGH_GET_CLIENT_STATS] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_CLIENT_STATS,
+        .arguments = get_client_stats_args,
+        .n_arguments = sizeof(get_client_stats_args) / sizeof(get_client_stats_args[0]),
+        .receive_cb = hidl_get_client_stats
+    },
+    [HIDL_PASSTHROUGH_QUERY_PARAMETERS] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_QUERY_PARAMETERS,
+        .arguments = query_parameters_args,
+        .n_arguments = sizeof(query_parameters_args) / sizeof(query_parameters_args[0]),
+        .receive_cb = hidl_query_parameters
+    },
+    [HIDL_PASSTHROUGH_GET_HELPER_WAKEUPS] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_HELPER_WAKEUPS,
+        .arguments = get_helper_wakeups_args,
+        .n_arguments = sizeof(get_helper_wakeups_args) / sizeof(get_helper_wakeups_args[0]),
+        .receive_cb = hidl_get_helper_wakeups
+    },
+    [HIDL_PASSTHROUGH_GET_TRACE_SIZE] = {
+        .method_name = HIDL_PASSTHROUGH_METHOD_GET_TRACE_SIZE,
+        .arguments = get_trace_size_args,
+        .n_arguments = sizeof(get_trace_size_args) / sizeof(get_trace_size_args[0]),
+        .receive_cb = hidl_get_trace_size
+    },
 };
 
 static pa_dbus_interface_info hidl_passthrough_info = {
@@ -156,210 +606,2053 @@ static void dbus_done(struct userdata *u) {
     u->dbus_protocol = NULL;
 }
 
-static void hidl_get_parameters(DBusConnection *conn, DBusMessage *msg, void *userdata) {
-    struct userdata *u;
-    DBusMessage *reply;
-    DBusError error;
-    char *keys = NULL;
-    char *key_value_pairs = NULL;
+/* One line per entry, stage times relative to when the request was
+ * received. */
+static char *flight_dump(struct userdata *u) {
+    struct hidl_flight_entry entry;
+    const struct hidl_flight_entry *e;
+    pa_strbuf *buf;
+    uint64_t iter = 0;
+    uint64_t received;
 
-    pa_assert_se((u = userdata));
-    dbus_error_init(&error);
+    pa_assert(u);
 
-    if (dbus_message_get_args(msg,
-                              &error,
-                              DBUS_TYPE_STRING,
-                              &keys,
-                              DBUS_TYPE_INVALID)) {
+    buf = pa_strbuf_new();
+
+    if (!u->flight_entries)
+        return pa_strbuf_to_string_free(buf);
+
+    while ((e = hidl_flight_next(&u->flight, &iter, &entry))) {
+        received = e->stage_usec[FLIGHT_RECEIVED];
+        pa_strbuf_printf(buf, "#%" PRIu64 " %s slot=%s len=%u hash=%08x result=%d received=%" PRIu64,
+                         e->seq,
+                         e->type == HIDL_FLIGHT_SET_PARAMETERS ? "set" : "get",
+                         e->slot[0] ? e->slot : "-",
+                         e->payload_len,
+                         e->payload_hash,
+                         e->result,
+                         received);
+        if (e->stage_usec[FLIGHT_HAL_BEGIN])
+            pa_strbuf_printf(buf, " hal=+%" PRIu64 "..+%" PRIu64,
+                             e->stage_usec[FLIGHT_HAL_BEGIN] - received,
+                             e->stage_usec[FLIGHT_HAL_END] - received);
+        pa_strbuf_printf(buf, " replied=+%" PRIu64 "\n", e->stage_usec[FLIGHT_REPLIED] - received);
+    }
+
+    return pa_strbuf_to_string_free(buf);
+}
 
-        pa_droid_hw_module_lock(u->hw_module);
-        key_value_pairs = u->hw_module->device->get_parameters(u->hw_module->device, keys);
-        pa_droid_hw_module_unlock(u->hw_module);
+/* Automatic dumps are rate limited so that a stuck HAL can't flood the log. */
+static void flight_dump_log(struct userdata *u, const char *reason) {
+    const char *state = NULL;
+    char *dump;
+    char *line;
+    pa_usec_t now;
 
-        pa_log_debug("get_parameters(\"%s\"): \"%s\"", keys, key_value_pairs ? key_value_pairs : "<null>");
+    pa_assert(u);
 
-        reply = dbus_message_new_method_return(msg);
-        dbus_message_append_args(reply,
-                                 DBUS_TYPE_STRING,
-                                 &key_value_pairs,
-                                 DBUS_TYPE_INVALID);
+    if (!u->flight_entries)
+        return;
 
-        pa_assert_se(dbus_connection_send(conn, reply, NULL));
-        dbus_message_unref(reply);
+    now = pa_rtclock_now();
+    if (u->flight_dumped && now < u->flight_dumped + FLIGHT_DUMP_INTERVAL)
         return;
-    }
+    u->flight_dumped = now;
 
-    pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Fail: %s", error.message);
-    dbus_error_free(&error);
+    pa_log_warn("Flight recorder dump, %s:", reason);
+
+    dump = flight_dump(u);
+    while ((line = pa_split(dump, "\n", &state))) {
+        pa_log_warn("  %s", line);
+        pa_xfree(line);
+    }
+    pa_xfree(dump);
 }
 
-static void hidl_set_parameters(DBusConnection *conn, DBusMessage *msg, void *userdata) {
-    struct userdata *u;
-    DBusError error;
-    char *key_value_pairs = NULL;
-    int ret;
+static void flight_record(struct userdata *u, enum hidl_flight_type type, const char *slot,
+                          const char *payload, pa_usec_t received, int result) {
+    const hidl_passthrough_timing *timing;
+    uint64_t stages[HIDL_FLIGHT_STAGES];
 
-    pa_assert_se((u = userdata));
-    dbus_error_init(&error);
+    pa_assert(u);
 
-    if (dbus_message_get_args(msg,
-                              &error,
-                              DBUS_TYPE_STRING,
-                              &key_value_pairs,
-                              DBUS_TYPE_INVALID)) {
+    if (!u->flight_entries)
+        return;
 
-        pa_log_debug("set_parameters(\"%s\")", key_value_pairs);
+    timing = hidl_passthrough_last_timing(u->passthrough);
 
-        pa_droid_hw_module_lock(u->hw_module);
-        ret = u->hw_module->device->set_parameters(u->hw_module->device, key_value_pairs);
-        pa_droid_hw_module_unlock(u->hw_module);
+    stages[FLIGHT_RECEIVED] = received;
+    stages[FLIGHT_HAL_BEGIN] = timing->hal_begin;
+    stages[FLIGHT_HAL_END] = timing->hal_end;
+    stages[FLIGHT_REPLIED] = pa_rtclock_now();
 
-        if (ret != 0) {
-            pa_log_warn("set_parameters(\"%s\") failed: %d", key_value_pairs, ret);
-            pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Failed to set parameters.");
-        } else {
-            pa_dbus_send_empty_reply(conn, msg);
-        }
+    hidl_flight_record(&u->flight, type, slot, payload, stages, result);
+
+    if (u->flight_deadline && stages[FLIGHT_REPLIED] - received > u->flight_deadline)
+        flight_dump_log(u, "request deadline exceeded");
+}
+
+static void trace_record(struct userdata *u, const struct request_trace *trace, bool set, const char *payload,
+                         pa_usec_t received, int result) {
+    const hidl_passthrough_timing *timing;
+    hidl_trace_entry *e;
+
+    pa_assert(u);
+
+    if (!u->trace || !trace)
         return;
-    }
 
-    pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Fail: %s", error.message);
-    dbus_error_free(&error);
+    timing = hidl_passthrough_last_timing(u->passthrough);
+
+    e = hidl_trace_add(u->trace, trace->boot_id, trace->id, trace->slot, set, payload);
+    e->result = result;
+    e->stage_usec[HIDL_TRACE_BINDER_RECEIVED] = trace->binder_received;
+    e->stage_usec[HIDL_TRACE_DBUS_SENT] = trace->dbus_sent;
+    e->stage_usec[HIDL_TRACE_MODULE_RECEIVED] = received;
+    e->stage_usec[HIDL_TRACE_LOCK_ACQUIRED] = timing->hal_begin;
+    e->stage_usec[HIDL_TRACE_HAL_RETURNED] = timing->hal_end;
+    e->stage_usec[HIDL_TRACE_REPLY_SENT] = pa_rtclock_now();
 }
 
-static void io_free(struct userdata *u) {
-    if (u->io_event) {
-        u->core->mainloop->io_free(u->io_event);
-        u->io_event = NULL;
+#ifdef HAVE_RTPOLL_ITEM_CALLBACK_USERDATA
+/* Called in the sink IO thread when it wakes up. */
+static void io_watch_after_cb(pa_rtpoll_item *i) {
+    struct io_watch *w = pa_rtpoll_item_get_after_userdata(i);
+
+    w->timer_elapsed = pa_rtpoll_timer_elapsed(w->rtpoll);
+}
+
+/* Called in the sink IO thread before it goes back to sleep. */
+static int io_watch_work_cb(pa_rtpoll_item *i) {
+    struct io_watch *w = pa_rtpoll_item_get_work_userdata(i);
+
+    if (w->timer_elapsed && !w->posted) {
+        w->posted = true;
+        pa_atomic_store(&w->y->written, w->generation);
+        pa_fdsem_post(w->y->fdsem);
     }
 
-    if (u->fd >= 0) {
-        pa_close(u->fd);
-        u->fd = -1;
+    return 0;
+}
+
+/* Called in the IO thread of the sink the message was posted to. */
+static int io_sync_process_msg(pa_msgobject *o, int code, void *data, int64_t offset, pa_memchunk *chunk) {
+    struct io_watch *w = data;
+
+    switch (code) {
+        case IO_SYNC_ARM:
+            /* Without rtpoll the wait times out. */
+            if (!(w->rtpoll = w->sink->thread_info.rtpoll))
+                return 0;
+            w->item = pa_rtpoll_item_new(w->rtpoll, PA_RTPOLL_LATE, 0);
+            pa_rtpoll_item_set_after_callback(w->item, io_watch_after_cb, w);
+            pa_rtpoll_item_set_work_callback(w->item, io_watch_work_cb, w);
+            return 0;
+
+        case IO_SYNC_DISARM:
+            /* NULL only flushes the queue. */
+            if (w && w->item)
+                pa_rtpoll_item_free(w->item);
+            return 0;
     }
+
+    return -1;
 }
+#endif
 
-static void io_event_cb(pa_mainloop_api*a, pa_io_event* e, int fd, pa_io_event_flags_t events, void *userdata) {
-    struct userdata *u = userdata;
-    char buffer[BUFFER_MAX];
-    ssize_t r;
+static bool io_apply_wanted(struct userdata *u, const char *key_value_pairs) {
+    const char *state = NULL;
+    const char *pattern_state;
+    char *pair;
+    char *pattern;
+    char *eq;
+    bool wanted = false;
 
-    pa_assert(u);
+    if (!u->io_thread_keys)
+        return true;
 
-    if (events & PA_IO_EVENT_INPUT) {
-        memset(buffer, 0, BUFFER_MAX);
-        if ((r = pa_read(u->fd, buffer, BUFFER_MAX, NULL)) > 0) {
-            if (log_level_debug())
-                pa_log_debug("[" HELPER_NAME "] %s", buffer);
-            else
-                pa_log("[" HELPER_NAME "] %s", buffer);
-        } else if (r < 0) {
-            pa_log("failed read");
-            io_free(u);
+    while (!wanted && (pair = pa_split(key_value_pairs, ";", &state))) {
+        if ((eq = strchr(pair, '=')))
+            *eq = '\0';
+
+        pattern_state = NULL;
+        while (!wanted && (pattern = pa_split(u->io_thread_keys, ",", &pattern_state))) {
+            wanted = fnmatch(pattern, pair, 0) == 0;
+            pa_xfree(pattern);
         }
-    } else if (events & PA_IO_EVENT_HANGUP) {
-        pa_log_debug("helper disappeared");
-        io_free(u);
-    } else if (events & PA_IO_EVENT_ERROR) {
-        pa_log("io error");
-        io_free(u);
+
+        pa_xfree(pair);
     }
+
+    return wanted;
 }
 
-int pa__init(pa_module *m) {
-    pa_modargs *ma = NULL;
-    const char *module_id;
-    bool helper = true;
-    char *dbus_address = NULL;
+static void changed_hook_fire(struct userdata *u, const char *key_value_pairs, pa_droid_hidl_origin_t origin,
+                              const char *slot, int result) {
+    pa_droid_hidl_changed_data data;
+    const char *state = NULL;
+    char *pair;
+    char *value;
+
+    data.parameters = pa_hashmap_new_full(pa_idxset_string_hash_func, pa_idxset_string_compare_func,
+                                          pa_xfree, NULL);
+    data.origin = origin;
+    data.slot = slot;
+    data.result = result;
+
+    /* Value is stored in the same allocation as the key. */
+    while ((pair = pa_split(key_value_pairs, ";", &state))) {
+        if ((value = strchr(pair, '=')))
+            *value++ = '\0';
+        else
+            value = pair + strlen(pair);
+
+        pa_hashmap_remove_and_free(data.parameters, pair);
+        pa_hashmap_put(data.parameters, pair, value);
+    }
 
-    pa_assert(m);
+    pa_hook_fire(&u->api->public.changed, &data);
 
-    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
-        pa_log("Failed to parse module arguments.");
-        goto fail;
+    pa_hashmap_free(data.parameters);
+}
+
+/* Tell in-process users about setParameters that reached the HAL. */
+static void notify_changed(struct userdata *u, const char *key_value_pairs, pa_droid_hidl_origin_t origin,
+                           const char *slot, int result) {
+    pa_droid_hidl_subscription *sub, *next;
+
+    if (!u->api)
+        return;
+
+    changed_hook_fire(u, key_value_pairs, origin, slot, result);
+
+    if (result != 0)
+        return;
+
+    for (sub = u->subscriptions; sub; sub = next) {
+        next = sub->next;
+        sub->cb(&u->api->public, key_value_pairs, sub->userdata);
     }
+}
 
-    log_init(&_log_level);
+/* get and set shared by D-Bus and in-process API. */
 
-    struct userdata *u = pa_xnew0(struct userdata, 1);
-    u->core = m->core;
-    m->userdata = u;
-    u->pid = (pid_t) -1;
-    u->fd = -1;
-    u->io_event = NULL;
+static char *parameters_get(struct userdata *u, const char *slot, const char *keys) {
+    char *key_value_pairs;
 
-    module_id = pa_modargs_get_value(ma, "module_id", DEFAULT_MODULE_ID);
-    if (pa_modargs_get_value_boolean(ma, "helper", &helper) < 0) {
-        pa_log("helper is boolean argument");
-        goto fail;
+    key_value_pairs = hidl_passthrough_get(u->passthrough, slot, keys);
+
+    /* Answer held back writes as if they were applied. */
+    if (u->defer)
+        key_value_pairs = hidl_defer_override(u->defer, keys, key_value_pairs);
+
+    return key_value_pairs;
+}
+
+static int parameters_set(struct userdata *u, const char *slot, const char *key_value_pairs,
+                          pa_droid_hidl_origin_t origin) {
+    char *now = NULL;
+    int ret = 0;
+
+    /* While suspended deferrable keys are buffered and the rest, if any,
+     * applied now. */
+    if (u->defer && u->suspended && !(now = hidl_defer_filter(u->defer, key_value_pairs))) {
+        pa_log_debug("set_parameters(\"%s\") deferred until resume", key_value_pairs);
+        return 0;
     }
 
-    if (!(u->hw_module = pa_droid_hw_module_get(u->core, NULL, module_id))) {
-        pa_log("Couldn't get hw module %s, is module-droid-card loaded?", module_id);
-        goto fail;
+    ret = hidl_passthrough_set(u->passthrough, slot, now ? now : key_value_pairs);
+
+    notify_changed(u, now ? now : key_value_pairs, origin, slot, ret);
+
+    pa_xfree(now);
+
+    return ret;
+}
+
+static void get_parameters(struct userdata *u, DBusConnection *conn, DBusMessage *msg, const char *keys,
+                           const struct request_trace *trace, pa_usec_t received) {
+    DBusMessage *reply;
+    char *key_value_pairs;
+    const char *slot = trace ? trace->slot : NULL;
+
+    key_value_pairs = parameters_get(u, slot, keys);
+
+    pa_log_debug("get_parameters(\"%s\"): \"%s\"", keys, key_value_pairs);
+
+    reply = dbus_message_new_method_return(msg);
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_STRING,
+                             &key_value_pairs,
+                             DBUS_TYPE_INVALID);
+
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+    pa_xfree(key_value_pairs);
+
+    HIDL_PROBE4(handler_exit, 0, keys, 0, pa_rtclock_now() - received);
+    trace_record(u, trace, false, keys, received, 0);
+    flight_record(u, HIDL_FLIGHT_GET_PARAMETERS, slot, keys, received, 0);
+}
+
+static void set_parameters(struct userdata *u, DBusConnection *conn, DBusMessage *msg, const char *key_value_pairs,
+                           const struct request_trace *trace, pa_usec_t received) {
+    const char *slot = trace ? trace->slot : NULL;
+    int ret;
+
+    pa_log_debug("set_parameters(\"%s\")", key_value_pairs);
+
+    ret = parameters_set(u, slot, key_value_pairs,
+                         trace ? PA_DROID_HIDL_ORIGIN_HELPER : PA_DROID_HIDL_ORIGIN_DBUS);
+
+    if (ret != 0) {
+        pa_log_warn("set_parameters(\"%s\") failed: %d", key_value_pairs, ret);
+        pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Failed to set parameters.");
+    } else
+        pa_dbus_send_empty_reply(conn, msg);
+
+    HIDL_PROBE4(handler_exit, 1, key_value_pairs, ret, pa_rtclock_now() - received);
+    trace_record(u, trace, true, key_value_pairs, received, ret);
+    flight_record(u, HIDL_FLIGHT_SET_PARAMETERS, slot, key_value_pairs, received, ret);
+}
+
+static char *api_get_parameters(pa_droid_hidl_api *api, const char *keys) {
+    struct userdata *u = ((struct api *) api)->u;
+    char *key_value_pairs;
+    pa_usec_t received;
+
+    pa_assert(keys);
+
+    if (!hidl_passthrough_attached(u->passthrough))
+        return NULL;
+
+    received = pa_rtclock_now();
+    HIDL_PROBE2(handler_entry, 0, keys);
+
+    key_value_pairs = parameters_get(u, NULL, keys);
+
+    HIDL_PROBE4(handler_exit, 0, keys, 0, pa_rtclock_now() - received);
+    flight_record(u, HIDL_FLIGHT_GET_PARAMETERS, NULL, keys, received, 0);
+
+    return key_value_pairs;
+}
+
+static int api_set_parameters(pa_droid_hidl_api *api, const char *key_value_pairs) {
+    struct userdata *u = ((struct api *) api)->u;
+    pa_usec_t received;
+    int ret;
+
+    pa_assert(key_value_pairs);
+
+    if (!hidl_passthrough_attached(u->passthrough))
+        return -1;
+
+    received = pa_rtclock_now();
+    HIDL_PROBE2(handler_entry, 1, key_value_pairs);
+
+    if ((ret = parameters_set(u, NULL, key_value_pairs, PA_DROID_HIDL_ORIGIN_MODULE)) != 0)
+        pa_log_warn("set_parameters(\"%s\") failed: %d", key_value_pairs, ret);
+
+    HIDL_PROBE4(handler_exit, 1, key_value_pairs, ret, pa_rtclock_now() - received);
+    flight_record(u, HIDL_FLIGHT_SET_PARAMETERS, NULL, key_value_pairs, received, ret);
+
+    return ret;
+}
+
+static pa_droid_hidl_subscription *api_subscribe(pa_droid_hidl_api *api, pa_droid_hidl_changed_cb_t cb,
+                                                 void *userdata) {
+    struct userdata *u = ((struct api *) api)->u;
+    pa_droid_hidl_subscription *sub;
+
+    pa_assert(cb);
+
+    sub = pa_xnew0(pa_droid_hidl_subscription, 1);
+    sub->cb = cb;
+    sub->userdata = userdata;
+    PA_LLIST_PREPEND(pa_droid_hidl_subscription, u->subscriptions, sub);
+
+    return sub;
+}
+
+static void api_unsubscribe(pa_droid_hidl_api *api, pa_droid_hidl_subscription *sub) {
+    struct userdata *u = ((struct api *) api)->u;
+
+    pa_assert(sub);
+
+    PA_LLIST_REMOVE(pa_droid_hidl_subscription, u->subscriptions, sub);
+    pa_xfree(sub);
+}
+
+static void api_register(struct userdata *u) {
+    pa_assert(u);
+
+    u->api = pa_xnew0(struct api, 1);
+    u->api->public.version = PA_DROID_HIDL_API_VERSION;
+    u->api->public.get_parameters = api_get_parameters;
+    u->api->public.set_parameters = api_set_parameters;
+    u->api->public.subscribe = api_subscribe;
+    u->api->public.unsubscribe = api_unsubscribe;
+    pa_hook_init(&u->api->public.changed, u->api);
+    pa_hook_init(&u->api->public.unloading, u->api);
+    u->api->u = u;
+
+    if (pa_shared_set(u->core, PA_DROID_HIDL_API_NAME, u->api) < 0) {
+        pa_log_warn("In-process API already registered by another instance.");
+        pa_hook_done(&u->api->public.unloading);
+        pa_hook_done(&u->api->public.changed);
+        pa_xfree(u->api);
+        u->api = NULL;
     }
+}
 
-    dbus_init(u);
+static void api_unregister(struct userdata *u) {
+    pa_droid_hidl_subscription *sub;
 
-    dbus_address = pa_get_dbus_address_from_server_type(u->core->server_type);
+    pa_assert(u);
 
-    if (helper) {
-        if ((u->fd = pa_start_child_for_read(HELPER_BINARY,
-                                             dbus_address, &u->pid)) < 0) {
-            pa_log("Failed to spawn " HELPER_NAME);
-            goto fail;
-        }
-        pa_xfree(dbus_address);
+    if (!u->api)
+        return;
 
-        pa_log_info("Helper running with pid %d", u->pid);
+    pa_shared_remove(u->core, PA_DROID_HIDL_API_NAME);
 
-        u->io_event = u->core->mainloop->io_new(u->core->mainloop,
-                                                u->fd,
-                                                PA_IO_EVENT_INPUT | PA_IO_EVENT_ERROR | PA_IO_EVENT_HANGUP,
-                                                io_event_cb,
-                                                u);
+    /* Users free their hook slots from here, before the hooks go away. */
+    pa_hook_fire(&u->api->public.unloading, NULL);
+
+    /* Tell subscribers the API is going away. */
+    while ((sub = u->subscriptions)) {
+        PA_LLIST_REMOVE(pa_droid_hidl_subscription, u->subscriptions, sub);
+        sub->cb(&u->api->public, NULL, sub->userdata);
+        pa_xfree(sub);
     }
 
-    return 0;
+    if (u->api->public.changed.slots || u->api->public.unloading.slots)
+        pa_log_warn("In-process API users left hook slots behind at unload.");
 
-fail:
-    if (ma)
-        pa_modargs_free(ma);
+    pa_hook_done(&u->api->public.unloading);
+    pa_hook_done(&u->api->public.changed);
 
-    pa_xfree(dbus_address);
+    pa_xfree(u->api);
+    u->api = NULL;
+}
 
-    pa__done(m);
+static bool droid_device(pa_module *m) {
+    return m && pa_startswith(m->name, "module-droid");
+}
 
-    return -1;
+/* Suspended when there are droid sinks or sources and none of them is
+ * opened. */
+static bool droid_suspended(struct userdata *u) {
+    pa_sink *sink;
+    pa_source *source;
+    unsigned devices = 0;
+    uint32_t idx;
+
+    PA_IDXSET_FOREACH(sink, u->core->sinks, idx) {
+        if (!droid_device(sink->module))
+            continue;
+        if (PA_SINK_IS_OPENED(sink->state))
+            return false;
+        devices++;
+    }
+
+    PA_IDXSET_FOREACH(source, u->core->sources, idx) {
+        if (!droid_device(source->module))
+            continue;
+        if (PA_SOURCE_IS_OPENED(source->state))
+            return false;
+        devices++;
+    }
+
+    return devices > 0;
 }
 
-void pa__done(pa_module *m) {
-    struct userdata *u;
+static void suspend_update(struct userdata *u) {
+    bool suspended;
+    char *batch;
+    int ret;
 
-    pa_assert(m);
+    suspended = droid_suspended(u);
 
-    if ((u = m->userdata)) {
-        dbus_done(u);
+    if (suspended == u->suspended)
+        return;
 
-        if (u->hw_module)
-            pa_droid_hw_module_unref(u->hw_module);
+    u->suspended = suspended;
+    pa_log_debug("droid sinks and sources %s.", suspended ? "suspended" : "resumed");
 
-        if (u->pid != (pid_t) -1) {
-            kill(u->pid, SIGTERM);
+    if (suspended || !(batch = hidl_defer_take(u->defer)))
+        return;
 
-            for (;;) {
-                if (waitpid(u->pid, NULL, 0) >= 0)
-                    break;
+    pa_log_debug("Applying deferred parameters \"%s\"", batch);
+    if ((ret = hidl_passthrough_set(u->passthrough, NULL, batch)) != 0)
+        pa_log_warn("Applying deferred parameters \"%s\" failed: %d", batch, ret);
+    notify_changed(u, batch, PA_DROID_HIDL_ORIGIN_DEFERRED, NULL, ret);
+    pa_xfree(batch);
+}
 
-                if (errno != EINTR) {
-                    pa_log("waitpid() failed: %s", pa_cstrerror(errno));
-                    break;
-                }
-            }
-        }
+static void suspend_defer_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    u->core->mainloop->defer_enable(e, 0);
+    suspend_update(u);
+}
+
+/* Check on next iteration, unlinked devices are gone by then. */
+static pa_hook_result_t device_changed_cb(pa_core *c, void *object, struct userdata *u) {
+    pa_assert(u);
+
+    u->core->mainloop->defer_enable(u->suspend_event, 1);
+
+    return PA_HOOK_OK;
+}
+
+static void suspend_tracking_start(struct userdata *u) {
+    static const pa_core_hook_t hooks[] = {
+        PA_CORE_HOOK_SINK_PUT,
+        PA_CORE_HOOK_SINK_UNLINK,
+        PA_CORE_HOOK_SINK_STATE_CHANGED,
+        PA_CORE_HOOK_SOURCE_PUT,
+        PA_CORE_HOOK_SOURCE_UNLINK,
+        PA_CORE_HOOK_SOURCE_STATE_CHANGED
+    };
+    unsigned i;
+
+    pa_assert(u);
+    pa_assert_cc(PA_ELEMENTSOF(hooks) == PA_ELEMENTSOF(u->suspend_slots));
+
+    u->suspend_event = u->core->mainloop->defer_new(u->core->mainloop, suspend_defer_cb, u);
+    u->core->mainloop->defer_enable(u->suspend_event, 0);
+
+    for (i = 0; i < PA_ELEMENTSOF(hooks); i++)
+        u->suspend_slots[i] = pa_hook_connect(&u->core->hooks[hooks[i]], PA_HOOK_LATE,
+                                              (pa_hook_cb_t) device_changed_cb, u);
+
+    u->suspended = droid_suspended(u);
+}
+
+static void suspend_tracking_stop(struct userdata *u) {
+    unsigned i;
+
+    pa_assert(u);
+
+    for (i = 0; i < PA_ELEMENTSOF(u->suspend_slots); i++) {
+        if (u->suspend_slots[i]) {
+            pa_hook_slot_free(u->suspend_slots[i]);
+            u->suspend_slots[i] = NULL;
+        }
+    }
+
+    if (u->suspend_event) {
+        u->core->mainloop->defer_free(u->suspend_event);
+        u->suspend_event = NULL;
+    }
+}
+
+static hidl_admission_client *client_get(struct userdata *u, DBusConnection *conn) {
+    hidl_admission_client *client;
+    unsigned long pid;
+    char *name;
+    bool exempt = false;
+
+    if ((client = dbus_connection_get_data(conn, u->client_slot)))
+        return client;
+
+    /* Only the helper we spawned is exempt, recognized by the pid the
+     * connection authenticated with. */
+    if (dbus_connection_get_unix_process_id(conn, &pid)) {
+        name = pa_sprintf_malloc("pid %lu", pid);
+        exempt = u->pid != (pid_t) -1 && (pid_t) pid == u->pid;
+    } else
+        name = pa_xstrdup("unknown");
+
+    client = hidl_admission_client_new(u->admission, name, exempt, conn);
+    pa_xfree(name);
+
+    if (!dbus_connection_set_data(conn, u->client_slot, client, (DBusFreeFunction) hidl_admission_client_free)) {
+        hidl_admission_client_free(client);
+        return NULL;
+    }
+
+    pa_log_debug("New client %s%s.", client->name, client->exempt ? " (exempt)" : "");
+
+    return client;
+}
+
+/* Returns false if request was rejected and error sent. Requests replayed
+ * after hw module appeared were already admitted. */
+static bool request_admit(struct userdata *u, DBusConnection *conn, DBusMessage *msg) {
+    hidl_admission_client *client;
+
+    if (u->replaying || !(client = client_get(u, conn)))
+        return true;
+
+    switch (hidl_admission_check(client, u->n_pending + u->n_queued)) {
+        case HIDL_ADMISSION_ACCEPT:
+            return true;
+
+        case HIDL_ADMISSION_RATE_LIMITED:
+            pa_dbus_send_error(conn, msg, DBUS_ERROR_LIMITS_EXCEEDED, "Request rate limit exceeded.");
+            return false;
+
+        case HIDL_ADMISSION_QUEUE_FULL:
+            pa_dbus_send_error(conn, msg, DBUS_ERROR_LIMITS_EXCEEDED, "Too many queued requests.");
+            return false;
+    }
+
+    pa_assert_not_reached();
+}
+
+/* Answer request and free it. */
+static void request_handle(struct userdata *u, struct queued_request *q) {
+    const struct request_trace *trace = q->traced ? &q->trace : NULL;
+
+    if (q->set)
+        set_parameters(u, q->conn, q->msg, q->payload, trace, q->received);
+    else
+        get_parameters(u, q->conn, q->msg, q->payload, trace, q->received);
+
+    dbus_message_unref(q->msg);
+    dbus_connection_unref(q->conn);
+    pa_xfree(q);
+}
+
+static void request_free(void *request) {
+    struct queued_request *q = request;
+
+    pa_dbus_send_error(q->conn, q->msg, DBUS_ERROR_FAILED, "Module unloaded.");
+    dbus_message_unref(q->msg);
+    dbus_connection_unref(q->conn);
+    pa_xfree(q);
+}
+
+/* The timeout or a late write of a disarmed watch don't matter, the
+ * generation moves on with the next wait. */
+static void io_sync_disarm(io_sync *y) {
+    if (y->watch) {
+        pa_asyncmsgq_post(y->sink->asyncmsgq, PA_MSGOBJECT(y), IO_SYNC_DISARM, y->watch, 0, NULL, pa_xfree);
+        y->watch = NULL;
+    }
+}
+
+/* Apply the waiting request and what queued behind it, until one of them
+ * has to wait again. */
+static void io_sync_release(struct userdata *u) {
+    io_sync *y = u->io_sync;
+    struct queued_request *q;
+
+    io_sync_disarm(y);
+    if (y->timeout_event) {
+        u->core->mainloop->time_free(y->timeout_event);
+        y->timeout_event = NULL;
+    }
+
+    q = y->request;
+    y->request = NULL;
+    u->n_queued--;
+    request_handle(u, q);
+
+    while (!y->request && (q = pa_queue_pop(y->queue))) {
+        u->n_queued--;
+        request_exec(u, q);
+    }
+}
+
+static void io_sync_timeout_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_log_debug("No write of %s completed, applying \"%s\" anyway", u->io_thread_sink, u->io_sync->request->payload);
+    io_sync_release(u);
+}
+
+static void io_sync_io_cb(pa_mainloop_api *a, pa_io_event *e, int fd, pa_io_event_flags_t events, void *userdata) {
+    struct userdata *u = userdata;
+    io_sync *y = u->io_sync;
+
+    pa_fdsem_after_poll(y->fdsem);
+
+    /* Posts of earlier waits are ignored. */
+    do {
+        if (y->request && pa_atomic_load(&y->written) == y->generation)
+            io_sync_release(u);
+    } while (pa_fdsem_before_poll(y->fdsem) < 0);
+}
+
+/* The sink is still registered while the hook runs, so the waiting
+ * request is released from the timeout callback once it is gone. Messages
+ * already posted are handled before the IO thread exits. */
+static pa_hook_result_t io_sync_unlink_cb(pa_core *c, pa_sink *sink, struct userdata *u) {
+    io_sync *y = u->io_sync;
+
+    if (sink != y->sink)
+        return PA_HOOK_OK;
+
+    io_sync_disarm(y);
+    y->sink = NULL;
+
+    if (y->timeout_event)
+        pa_core_rttime_restart(u->core, y->timeout_event, pa_rtclock_now());
+
+    return PA_HOOK_OK;
+}
+
+/* Returns true if q has to wait for a write of io_thread_sink, or queue
+ * behind a request that does. */
+static bool io_sync_hold(struct userdata *u, struct queued_request *q) {
+    io_sync *y = u->io_sync;
+    pa_sink *sink;
+
+    if (y->request) {
+        pa_queue_push(y->queue, q);
+        u->n_queued++;
+        return true;
+    }
+
+    if (!q->set ||
+        !(sink = pa_namereg_get(u->core, u->io_thread_sink, PA_NAMEREG_SINK)) ||
+        sink->state != PA_SINK_RUNNING ||
+        !io_apply_wanted(u, q->payload))
+        return false;
+
+    y->request = q;
+    y->generation++;
+    y->sink = sink;
+    y->watch = pa_xnew0(struct io_watch, 1);
+    y->watch->y = y;
+    y->watch->sink = sink;
+    y->watch->generation = y->generation;
+    pa_asyncmsgq_post(sink->asyncmsgq, PA_MSGOBJECT(y), IO_SYNC_ARM, y->watch, 0, NULL, NULL);
+
+    y->timeout_event = pa_core_rttime_new(u->core, pa_rtclock_now() + IO_SYNC_TIMEOUT, io_sync_timeout_cb, u);
+    u->n_queued++;
+
+    return true;
+}
+
+/* Answer request now, unless it has to wait for io_thread_sink. */
+static void request_exec(struct userdata *u, struct queued_request *q) {
+    if (u->io_sync && io_sync_hold(u, q))
+        return;
+
+    request_handle(u, q);
+}
+
+static void request_run(void *request, void *userdata) {
+    struct userdata *u = userdata;
+
+    u->n_queued--;
+    request_exec(u, request);
+}
+
+/* Run get or set request now, or queue it if requests are scheduled by
+ * priority. */
+static void request_dispatch(struct userdata *u, DBusConnection *conn, DBusMessage *msg, bool set,
+                             const char *payload, const struct request_trace *trace) {
+    struct queued_request *q;
+    pa_usec_t received;
+
+    received = pa_rtclock_now();
+    HIDL_PROBE2(handler_entry, set, payload);
+
+    q = pa_xnew0(struct queued_request, 1);
+    q->conn = dbus_connection_ref(conn);
+    q->msg = dbus_message_ref(msg);
+    q->set = set;
+    q->payload = payload;
+    if ((q->traced = !!trace))
+        q->trace = *trace;
+    q->received = received;
+
+    if (!u->sched) {
+        request_exec(u, q);
+        return;
+    }
+
+    /* Only the helper uses the traced methods. */
+    u->n_queued++;
+    hidl_sched_push(u->sched, conn, hidl_sched_classify(u->sched, payload, q->traced), q);
+}
+
+#ifdef HAVE_RTPOLL_ITEM_CALLBACK_USERDATA
+static io_sync *io_sync_new(struct userdata *u) {
+    io_sync *y;
+
+    y = pa_msgobject_new(io_sync);
+    y->parent.process_msg = io_sync_process_msg;
+    y->fdsem = pa_fdsem_new();
+    y->io_event = u->core->mainloop->io_new(u->core->mainloop, pa_fdsem_get(y->fdsem), PA_IO_EVENT_INPUT,
+                                            io_sync_io_cb, u);
+    pa_fdsem_before_poll(y->fdsem);
+    pa_atomic_store(&y->written, 0);
+    y->request = NULL;
+    y->queue = pa_queue_new();
+    y->generation = 0;
+    y->watch = NULL;
+    y->timeout_event = NULL;
+    y->sink = NULL;
+    y->unlink_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SINK_UNLINK], PA_HOOK_NORMAL,
+                                     (pa_hook_cb_t) io_sync_unlink_cb, u);
+
+    return y;
+}
+#endif
+
+static void io_sync_free(struct userdata *u) {
+    io_sync *y = u->io_sync;
+
+    pa_hook_slot_free(y->unlink_slot);
+    if (y->timeout_event)
+        u->core->mainloop->time_free(y->timeout_event);
+
+    /* The IO thread must be done with y and the watch before they are
+     * freed. */
+    if (y->sink) {
+        pa_asyncmsgq_send(y->sink->asyncmsgq, PA_MSGOBJECT(y), IO_SYNC_DISARM, y->watch, 0, NULL);
+        pa_xfree(y->watch);
+    }
+
+    if (y->request)
+        request_free(y->request);
+    pa_queue_free(y->queue, request_free);
+
+    u->core->mainloop->io_free(y->io_event);
+    pa_fdsem_free(y->fdsem);
+    io_sync_unref(y);
+    u->io_sync = NULL;
+}
+
+static void hidl_get_parameters(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusError error;
+    char *keys = NULL;
+
+    pa_assert_se((u = userdata));
+
+    if (!request_admit(u, conn, msg))
+        return;
+
+    if (!hidl_passthrough_attached(u->passthrough)) {
+        pending_add(u, conn, msg, hidl_get_parameters);
+        return;
+    }
+
+    dbus_error_init(&error);
+
+    if (dbus_message_get_args(msg,
+                              &error,
+                              DBUS_TYPE_STRING,
+                              &keys,
+                              DBUS_TYPE_INVALID)) {
+        request_dispatch(u, conn, msg, false, keys, NULL);
+        return;
+    }
+
+    pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Fail: %s", error.message);
+    dbus_error_free(&error);
+}
+
+static void hidl_set_parameters(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusError error;
+    char *key_value_pairs = NULL;
+
+    pa_assert_se((u = userdata));
+
+    if (!request_admit(u, conn, msg))
+        return;
+
+    if (!hidl_passthrough_attached(u->passthrough)) {
+        pending_add(u, conn, msg, hidl_set_parameters);
+        return;
+    }
+
+    dbus_error_init(&error);
+
+    if (dbus_message_get_args(msg,
+                              &error,
+                              DBUS_TYPE_STRING,
+                              &key_value_pairs,
+                              DBUS_TYPE_INVALID)) {
+        request_dispatch(u, conn, msg, true, key_value_pairs, NULL);
+        return;
+    }
+
+    pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Fail: %s", error.message);
+    dbus_error_free(&error);
+}
+
+static void hidl_get_parameters_traced(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    struct request_trace trace;
+    DBusError error;
+    char *keys = NULL;
+
+    pa_assert_se((u = userdata));
+
+    if (!request_admit(u, conn, msg))
+        return;
+
+    if (!hidl_passthrough_attached(u->passthrough)) {
+        pending_add(u, conn, msg, hidl_get_parameters_traced);
+        return;
+    }
+
+    dbus_error_init(&error);
+
+    if (dbus_message_get_args(msg,
+                              &error,
+                              DBUS_TYPE_UINT64,
+                              &trace.boot_id,
+                              DBUS_TYPE_UINT64,
+                              &trace.id,
+                              DBUS_TYPE_STRING,
+                              &trace.slot,
+                              DBUS_TYPE_UINT64,
+                              &trace.binder_received,
+                              DBUS_TYPE_UINT64,
+                              &trace.dbus_sent,
+                              DBUS_TYPE_STRING,
+                              &keys,
+                              DBUS_TYPE_INVALID)) {
+        request_dispatch(u, conn, msg, false, keys, &trace);
+        return;
+    }
+
+    pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Fail: %s", error.message);
+    dbus_error_free(&error);
+}
+
+static void hidl_set_parameters_traced(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    struct request_trace trace;
+    DBusError error;
+    char *key_value_pairs = NULL;
+
+    pa_assert_se((u = userdata));
+
+    if (!request_admit(u, conn, msg))
+        return;
+
+    if (!hidl_passthrough_attached(u->passthrough)) {
+        pending_add(u, conn, msg, hidl_set_parameters_traced);
+        return;
+    }
+
+    dbus_error_init(&error);
+
+    if (dbus_message_get_args(msg,
+                              &error,
+                              DBUS_TYPE_UINT64,
+                              &trace.boot_id,
+                              DBUS_TYPE_UINT64,
+                              &trace.id,
+                              DBUS_TYPE_STRING,
+                              &trace.slot,
+                              DBUS_TYPE_UINT64,
+                              &trace.binder_received,
+                              DBUS_TYPE_UINT64,
+                              &trace.dbus_sent,
+                              DBUS_TYPE_STRING,
+                              &key_value_pairs,
+                              DBUS_TYPE_INVALID)) {
+        request_dispatch(u, conn, msg, true, key_value_pairs, &trace);
+        return;
+    }
+
+    pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Fail: %s", error.message);
+    dbus_error_free(&error);
+}
+
+/* Last stage of a traced request, sent by the helper after replying to the
+ * binder request, usually without expecting a reply. */
+static void hidl_report_trace(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusError error;
+    dbus_uint64_t boot_id;
+    dbus_uint64_t id;
+    dbus_uint64_t binder_replied;
+    hidl_trace_entry *e;
+
+    pa_assert_se((u = userdata));
+
+    dbus_error_init(&error);
+
+    if (dbus_message_get_args(msg,
+                              &error,
+                              DBUS_TYPE_UINT64,
+                              &boot_id,
+                              DBUS_TYPE_UINT64,
+                              &id,
+                              DBUS_TYPE_UINT64,
+                              &binder_replied,
+                              DBUS_TYPE_INVALID)) {
+        if (u->trace && (e = hidl_trace_find(u->trace, boot_id, id)))
+            e->stage_usec[HIDL_TRACE_BINDER_REPLIED] = binder_replied;
+
+        if (!dbus_message_get_no_reply(msg))
+            pa_dbus_send_empty_reply(conn, msg);
+        return;
+    }
+
+    pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Fail: %s", error.message);
+    dbus_error_free(&error);
+}
+
+static void hidl_get_traces(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    DBusMessageIter iter, array, entry;
+    const hidl_trace_entry *e;
+    unsigned state = 0;
+    unsigned i;
+
+    pa_assert_se((u = userdata));
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_iter_init_append(reply, &iter);
+    pa_assert_se(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(tsbsittttttt)", &array));
+
+    while (u->trace && (e = hidl_trace_iterate(u->trace, &state))) {
+        const char *slot = e->slot ? e->slot : "";
+        const char *payload = e->payload ? e->payload : "";
+        dbus_bool_t set = e->set;
+        dbus_int32_t result = e->result;
+
+        pa_assert_se(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &e->id));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &slot));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN, &set));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &payload));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_INT32, &result));
+        for (i = 0; i < HIDL_TRACE_STAGES; i++)
+            pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &e->stage_usec[i]));
+        pa_assert_se(dbus_message_iter_close_container(&array, &entry));
+    }
+
+    pa_assert_se(dbus_message_iter_close_container(&iter, &array));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+static void hidl_get_statistics(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    DBusMessageIter iter, array;
+    hidl_stats *stats;
+
+    pa_assert_se((u = userdata));
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_iter_init_append(reply, &iter);
+
+    if ((stats = hidl_passthrough_stats(u->passthrough)))
+        hidl_stats_append(stats, hidl_passthrough_stats_size(u->passthrough), &iter);
+    else {
+        pa_assert_se(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, HIDL_STATS_ENTRY_SIGNATURE, &array));
+        pa_assert_se(dbus_message_iter_close_container(&iter, &array));
+    }
+
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+static void hidl_get_slow_hal_calls(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    DBusMessageIter iter, array, entry;
+    const hidl_watchdog_entry *e;
+    hidl_watchdog *watchdog;
+    void *state = NULL;
+
+    pa_assert_se((u = userdata));
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_iter_init_append(reply, &iter);
+    pa_assert_se(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(stt)", &array));
+
+    watchdog = hidl_passthrough_watchdog(u->passthrough);
+    while (watchdog && (e = hidl_watchdog_iterate(watchdog, &state))) {
+        pa_assert_se(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &e->key));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &e->slow));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &e->max_usec));
+        pa_assert_se(dbus_message_iter_close_container(&array, &entry));
+    }
+
+    pa_assert_se(dbus_message_iter_close_container(&iter, &array));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+static void hidl_get_priority_stats(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    DBusMessageIter iter, array, entry;
+    const hidl_sched_stats *stats;
+    const char *name;
+    unsigned i;
+
+    pa_assert_se((u = userdata));
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_iter_init_append(reply, &iter);
+    pa_assert_se(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(stt)", &array));
+
+    for (i = 0; u->sched && i < HIDL_SCHED_CLASSES; i++) {
+        name = hidl_sched_class_to_string(i);
+        stats = hidl_sched_get_stats(u->sched, i);
+
+        pa_assert_se(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &name));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &stats->count));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &stats->wait_usec));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &stats->max_wait_usec));
+        pa_assert_se(dbus_message_iter_close_container(&array, &entry));
+    }
+
+    pa_assert_se(dbus_message_iter_close_container(&iter, &array));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+struct query {
+    pa_strbuf *keys;
+    pa_strbuf *pairs;
+    pa_usec_t stale_before;
+};
+
+static void query_stale_cb(const hidl_state_entry *entry, void *userdata) {
+    struct query *q = userdata;
+
+    if (entry->updated < q->stale_before)
+        pa_strbuf_printf(q->keys, "%s%s", pa_strbuf_isempty(q->keys) ? "" : ";", entry->key);
+}
+
+static void query_collect_cb(const hidl_state_entry *entry, void *userdata) {
+    struct query *q = userdata;
+
+    pa_strbuf_printf(q->keys, "%s%s", pa_strbuf_isempty(q->keys) ? "" : ";", entry->key);
+    pa_strbuf_printf(q->pairs, "%s%s=%s", pa_strbuf_isempty(q->pairs) ? "" : ";", entry->key, entry->value);
+}
+
+/* Answer from tracked state, optionally refreshing stale matches first with
+ * one getParameters. */
+static void hidl_query_parameters(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusError error;
+    DBusMessage *reply;
+    hidl_state *state;
+    struct query q;
+    const char *pattern;
+    dbus_bool_t refresh;
+    char *keys;
+    char *key_value_pairs;
+    pa_usec_t now;
+
+    pa_assert_se((u = userdata));
+
+    dbus_error_init(&error);
+
+    if (!dbus_message_get_args(msg,
+                               &error,
+                               DBUS_TYPE_STRING,
+                               &pattern,
+                               DBUS_TYPE_BOOLEAN,
+                               &refresh,
+                               DBUS_TYPE_INVALID)) {
+        pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "Fail: %s", error.message);
+        dbus_error_free(&error);
+        return;
+    }
+
+    if (!(state = hidl_passthrough_state(u->passthrough))) {
+        pa_dbus_send_error(conn, msg, DBUS_ERROR_NOT_SUPPORTED, "Parameter state is not tracked.");
+        return;
+    }
+
+    if (refresh) {
+        if (!request_admit(u, conn, msg))
+            return;
+
+        if (!hidl_passthrough_attached(u->passthrough)) {
+            pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "hw module is not available.");
+            return;
+        }
+
+        now = pa_rtclock_now();
+        q.stale_before = now > u->query_max_age ? now - u->query_max_age : 0;
+        q.keys = pa_strbuf_new();
+        hidl_state_query(state, pattern, query_stale_cb, &q);
+
+        if (!pa_strbuf_isempty(q.keys)) {
+            keys = pa_strbuf_to_string_free(q.keys);
+            pa_log_debug("query_parameters(\"%s\"): refreshing \"%s\"", pattern, keys);
+
+            pa_xfree(parameters_get(u, NULL, keys));
+            pa_xfree(keys);
+        } else
+            pa_strbuf_free(q.keys);
+    }
+
+    q.keys = pa_strbuf_new();
+    q.pairs = pa_strbuf_new();
+    hidl_state_query(state, pattern, query_collect_cb, &q);
+
+    keys = pa_strbuf_to_string_free(q.keys);
+    key_value_pairs = pa_strbuf_to_string_free(q.pairs);
+
+    /* Answer held back writes as if they were applied. */
+    if (u->defer && *keys)
+        key_value_pairs = hidl_defer_override(u->defer, keys, key_value_pairs);
+
+    pa_log_debug("query_parameters(\"%s\"): \"%s\"", pattern, key_value_pairs);
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_STRING,
+                             &key_value_pairs,
+                             DBUS_TYPE_INVALID);
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+
+    pa_xfree(keys);
+    pa_xfree(key_value_pairs);
+}
+
+static void hidl_get_client_stats(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    DBusMessageIter iter, array, entry;
+    hidl_admission_client *client;
+    dbus_bool_t exempt;
+    void *state = NULL;
+
+    pa_assert_se((u = userdata));
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_iter_init_append(reply, &iter);
+    pa_assert_se(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(sbttt)", &array));
+
+    while (u->admission && (client = hidl_admission_iterate(u->admission, &state))) {
+        exempt = client->exempt;
+
+        pa_assert_se(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &client->name));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_BOOLEAN, &exempt));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &client->accepted));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &client->rate_limited));
+        pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &client->queue_full));
+        pa_assert_se(dbus_message_iter_close_container(&array, &entry));
+    }
+
+    pa_assert_se(dbus_message_iter_close_container(&iter, &array));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+/* Counters are from the latest heartbeat, so at most
+ * HELPER_HEARTBEAT_INTERVAL_MS old. Empty when there is no helper. */
+static void hidl_get_helper_wakeups(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    DBusMessageIter iter, array, entry;
+    const char *wakeups = NULL;
+    const char *state = NULL;
+    char *field = NULL, *source;
+
+    pa_assert_se((u = userdata));
+
+    if (u->heartbeat && (wakeups = strstr(u->heartbeat, HELPER_HEARTBEAT_WAKEUPS)))
+        field = pa_split_spaces(wakeups + strlen(HELPER_HEARTBEAT_WAKEUPS), &state);
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_iter_init_append(reply, &iter);
+    pa_assert_se(dbus_message_iter_open_container(&iter, DBUS_TYPE_ARRAY, "(stt)", &array));
+
+    state = NULL;
+    while (field && (source = pa_split(field, ",", &state))) {
+        char name[32];
+        uint64_t count, cpu_usec;
+        const char *p = name;
+
+        if (sscanf(source, "%31[^:]:%" SCNu64 ":%" SCNu64, name, &count, &cpu_usec) == 3) {
+            pa_assert_se(dbus_message_iter_open_container(&array, DBUS_TYPE_STRUCT, NULL, &entry));
+            pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &p));
+            pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &count));
+            pa_assert_se(dbus_message_iter_append_basic(&entry, DBUS_TYPE_UINT64, &cpu_usec));
+            pa_assert_se(dbus_message_iter_close_container(&array, &entry));
+        }
+
+        pa_xfree(source);
+    }
+
+    pa_assert_se(dbus_message_iter_close_container(&iter, &array));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+
+    pa_xfree(field);
+}
+
+/* Asked by the helper when it connects, it doesn't report traces if 0. */
+static void hidl_get_trace_size(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    dbus_uint32_t size;
+
+    pa_assert_se((u = userdata));
+
+    size = u->trace ? hidl_trace_size(u->trace) : 0;
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_UINT32,
+                             &size,
+                             DBUS_TYPE_INVALID);
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+/* Asked by the helper when it connects. */
+static void hidl_get_optimistic_keys(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    const char *keys;
+
+    pa_assert_se((u = userdata));
+
+    keys = u->optimistic_keys ? u->optimistic_keys : "";
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    dbus_message_append_args(reply,
+                             DBUS_TYPE_STRING,
+                             &keys,
+                             DBUS_TYPE_INVALID);
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+}
+
+static void hidl_dump_flight_recorder(DBusConnection *conn, DBusMessage *msg, void *userdata) {
+    struct userdata *u;
+    DBusMessage *reply;
+    char *dump;
+
+    pa_assert_se((u = userdata));
+
+    dump = flight_dump(u);
+
+    pa_assert_se((reply = dbus_message_new_method_return(msg)));
+    pa_assert_se(dbus_message_append_args(reply, DBUS_TYPE_STRING, &dump, DBUS_TYPE_INVALID));
+    pa_assert_se(dbus_connection_send(conn, reply, NULL));
+    dbus_message_unref(reply);
+    pa_xfree(dump);
+}
+
+static void pending_free(struct userdata *u, struct pending_request *p) {
+    if (u->pending_tail == p)
+        u->pending_tail = p->prev;
+    PA_LLIST_REMOVE(struct pending_request, u->pending, p);
+    u->n_pending--;
+    dbus_message_unref(p->msg);
+    dbus_connection_unref(p->conn);
+    pa_xfree(p);
+}
+
+static void pending_timeout_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+    pa_usec_t now;
+
+    pa_assert(u);
+
+    now = pa_rtclock_now();
+
+    if (u->pending && u->pending->deadline <= now)
+        flight_dump_log(u, "request timed out waiting for hw module");
+
+    /* Requests are queued in deadline order. */
+    while (u->pending && u->pending->deadline <= now) {
+        pa_log_info("Request timed out waiting for hw module.");
+        pa_dbus_send_error(u->pending->conn, u->pending->msg, DBUS_ERROR_FAILED, "hw module is not available.");
+        pending_free(u, u->pending);
+    }
+
+    if (u->pending)
+        pa_core_rttime_restart(u->core, u->pending_event, u->pending->deadline);
+}
+
+static void pending_add(struct userdata *u, DBusConnection *conn, DBusMessage *msg, pa_dbus_receive_cb_t receive_cb) {
+    struct pending_request *p;
+
+    pa_assert(u);
+
+    if (u->pending_timeout == 0 || u->n_pending >= PENDING_MAX) {
+        pa_dbus_send_error(conn, msg, DBUS_ERROR_FAILED, "hw module is not available.");
+        return;
+    }
+
+    p = pa_xnew0(struct pending_request, 1);
+    p->conn = dbus_connection_ref(conn);
+    p->msg = dbus_message_ref(msg);
+    p->receive_cb = receive_cb;
+    p->deadline = pa_rtclock_now() + u->pending_timeout;
+
+    PA_LLIST_INSERT_AFTER(struct pending_request, u->pending, u->pending_tail, p);
+    u->pending_tail = p;
+    u->n_pending++;
+
+    if (!u->pending_event)
+        u->pending_event = pa_core_rttime_new(u->core, p->deadline, pending_timeout_cb, u);
+    else if (p == u->pending)
+        pa_core_rttime_restart(u->core, u->pending_event, p->deadline);
+}
+
+static void pending_flush(struct userdata *u) {
+    struct pending_request *p;
+
+    pa_assert(u);
+
+    if (u->pending_event) {
+        u->core->mainloop->time_free(u->pending_event);
+        u->pending_event = NULL;
+    }
+
+    while ((p = u->pending)) {
+        if (u->passthrough && hidl_passthrough_attached(u->passthrough)) {
+            u->replaying = true;
+            p->receive_cb(p->conn, p->msg, u);
+            u->replaying = false;
+        } else
+            pa_dbus_send_error(p->conn, p->msg, DBUS_ERROR_FAILED, "Module unloaded.");
+        pending_free(u, p);
+    }
+}
+
+static void attach_stop(struct userdata *u) {
+    pa_assert(u);
+
+    if (u->attach_event) {
+        u->core->mainloop->defer_free(u->attach_event);
+        u->attach_event = NULL;
+    }
+
+    if (u->card_put_slot) {
+        pa_hook_slot_free(u->card_put_slot);
+        u->card_put_slot = NULL;
+    }
+
+    if (u->sink_put_slot) {
+        pa_hook_slot_free(u->sink_put_slot);
+        u->sink_put_slot = NULL;
+    }
+
+    if (u->source_put_slot) {
+        pa_hook_slot_free(u->source_put_slot);
+        u->source_put_slot = NULL;
+    }
+}
+
+static bool hw_module_attach(struct userdata *u) {
+    pa_assert(u);
+
+    if (!hidl_passthrough_attach(u->passthrough))
+        return false;
+
+    pending_flush(u);
+
+    return true;
+}
+
+static void attach_cb(struct userdata *u) {
+    pa_assert(u);
+
+    if (hw_module_attach(u))
+        attach_stop(u);
+}
+
+static void attach_defer_cb(pa_mainloop_api *a, pa_defer_event *e, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    u->core->mainloop->defer_enable(e, 0);
+    attach_cb(u);
+}
+
+/* Droid modules create the hw module before putting their card, sink or
+ * source, so these are the only points where attaching is retried. Check
+ * on next iteration so that the creating module has finished first. */
+static pa_hook_result_t object_put_cb(pa_core *c, void *object, struct userdata *u) {
+    pa_assert(u);
+
+    u->core->mainloop->defer_enable(u->attach_event, 1);
+
+    return PA_HOOK_OK;
+}
+
+static void attach_start(struct userdata *u) {
+    pa_assert(u);
+
+    pa_log_info("hw modules not available yet, waiting for them to appear.");
+
+    u->attach_event = u->core->mainloop->defer_new(u->core->mainloop, attach_defer_cb, u);
+    u->core->mainloop->defer_enable(u->attach_event, 0);
+
+    u->card_put_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_CARD_PUT], PA_HOOK_LATE,
+                                       (pa_hook_cb_t) object_put_cb, u);
+    u->sink_put_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SINK_PUT], PA_HOOK_LATE,
+                                       (pa_hook_cb_t) object_put_cb, u);
+    u->source_put_slot = pa_hook_connect(&u->core->hooks[PA_CORE_HOOK_SOURCE_PUT], PA_HOOK_LATE,
+                                         (pa_hook_cb_t) object_put_cb, u);
+}
+
+static void io_free(struct userdata *u) {
+    if (u->io_event) {
+        u->core->mainloop->io_free(u->io_event);
+        u->io_event = NULL;
+    }
+
+    if (u->fd >= 0) {
+        pa_close(u->fd);
+        u->fd = -1;
+    }
+
+    pa_xfree(u->output);
+    u->output = NULL;
+}
+
+static void time_event_free(struct userdata *u, pa_time_event **e) {
+    if (*e) {
+        u->core->mainloop->time_free(*e);
+        *e = NULL;
+    }
+}
+
+static void helper_start(struct userdata *u);
+static void helper_stop(struct userdata *u, int sig);
+static int helper_spawn(struct userdata *u);
+
+static void watchdog_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    pa_log_warn("No heartbeat from " HELPER_NAME " (pid %d) for %" PRIu64 " ms, last state: %s",
+                u->pid,
+                (pa_rtclock_now() - u->heartbeat_time) / PA_USEC_PER_MSEC,
+                u->heartbeat ? u->heartbeat : "unknown");
+    flight_dump_log(u, "helper watchdog");
+
+    /* A wedged main loop doesn't handle SIGTERM. */
+    helper_stop(u, SIGKILL);
+    helper_start(u);
+}
+
+static void helper_heartbeat(struct userdata *u, const char *state) {
+    pa_assert(u);
+
+    u->heartbeat_time = pa_rtclock_now();
+    pa_xfree(u->heartbeat);
+    u->heartbeat = pa_xstrdup(state);
+
+    if (!u->helper_watchdog)
+        return;
+
+    if (u->watchdog_event)
+        pa_core_rttime_restart(u->core, u->watchdog_event, u->heartbeat_time + u->helper_watchdog);
+    else
+        u->watchdog_event = pa_core_rttime_new(u->core, u->heartbeat_time + u->helper_watchdog, watchdog_cb, u);
+}
+
+static void helper_line(struct userdata *u, char *line) {
+    if (!*line)
+        return;
+
+    if (pa_startswith(line, HELPER_HEARTBEAT))
+        helper_heartbeat(u, pa_strip(line + strlen(HELPER_HEARTBEAT)));
+    else if (log_level_debug())
+        pa_log_debug("[" HELPER_NAME "] %s", line);
+    else
+        pa_log("[" HELPER_NAME "] %s", line);
+}
+
+/* Reads may end in the middle of a line, the rest of it is kept until the
+ * next read. */
+static void helper_output(struct userdata *u, const char *output) {
+    char *data;
+    char *line;
+    char *end;
+
+    data = u->output ? pa_sprintf_malloc("%s%s", u->output, output) : pa_xstrdup(output);
+    pa_xfree(u->output);
+    u->output = NULL;
+
+    for (line = data; (end = strchr(line, '\n')); line = end + 1) {
+        *end = '\0';
+        helper_line(u, line);
+    }
+
+    if (strlen(line) >= HELPER_LINE_MAX)
+        helper_line(u, line);
+    else if (*line)
+        u->output = pa_xstrdup(line);
+
+    pa_xfree(data);
+}
+
+static void ofono_changed_cb(void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    if (!hidl_ofono_has_binder_slots())
+        return;
+
+    pa_log_info("Binder slots configured for oFono, starting " HELPER_NAME ".");
+    hidl_ofono_watch_free(u->ofono_watch);
+    u->ofono_watch = NULL;
+    helper_start(u);
+}
+
+static void ofono_watch_start(struct userdata *u) {
+    pa_assert(u);
+
+    if (!u->ofono_watch)
+        u->ofono_watch = hidl_ofono_watch_new(u->core, ofono_changed_cb, u);
+}
+
+static void restart_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    time_event_free(u, &u->restart_event);
+    helper_spawn(u);
+}
+
+static void helper_restart(struct userdata *u) {
+    pa_assert(u);
+
+    if (u->restart_event)
+        return;
+
+    pa_log_info("Restarting " HELPER_NAME " in %" PRIu64 " ms.", u->restart_delay / PA_USEC_PER_MSEC);
+    u->restart_event = pa_core_rttime_new(u->core, pa_rtclock_now() + u->restart_delay, restart_cb, u);
+    u->restart_delay = PA_MIN(u->restart_delay * 2, HELPER_RESTART_MAX);
+}
+
+/* Spawn the helper only if oFono has binder slots for it to serve,
+ * otherwise wait for them to be configured. Returns negative if spawning
+ * failed. */
+static int helper_spawn(struct userdata *u) {
+    pa_assert(u);
+
+    if (hidl_ofono_has_binder_slots()) {
+        helper_start(u);
+        return u->pid == (pid_t) -1 ? -1 : 0;
+    }
+
+    pa_log_info("No binder slots configured for oFono, not starting " HELPER_NAME ".");
+    ofono_watch_start(u);
+
+    return 0;
+}
+
+static void reap_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata);
+
+/* Reap the helper without blocking the main loop, and restart it unless it
+ * exited because there are no slots to serve. */
+static void helper_reap(struct userdata *u) {
+    int status = 0;
+    pid_t r;
+
+    pa_assert(u);
+    pa_assert(u->pid != (pid_t) -1);
+
+    while ((r = waitpid(u->pid, &status, WNOHANG)) < 0 && errno == EINTR)
+        ;
+
+    if (r == 0) {
+        if (++u->reap_tries == HELPER_REAP_TRIES) {
+            pa_log_warn(HELPER_NAME " (pid %d) closed its output but doesn't exit, killing it.", u->pid);
+            kill(u->pid, SIGKILL);
+        }
+
+        if (u->reap_event)
+            pa_core_rttime_restart(u->core, u->reap_event, pa_rtclock_now() + HELPER_REAP_INTERVAL);
+        else
+            u->reap_event = pa_core_rttime_new(u->core, pa_rtclock_now() + HELPER_REAP_INTERVAL, reap_cb, u);
+        return;
+    }
+
+    time_event_free(u, &u->reap_event);
+    u->pid = (pid_t) -1;
+
+    if (r < 0)
+        pa_log("waitpid() failed: %s", pa_cstrerror(errno));
+    else if (WIFEXITED(status) && WEXITSTATUS(status) == HELPER_EXIT_NO_SLOTS) {
+        /* The helper exits on purpose when its last slot is removed. */
+        pa_log_info("No binder slots left, " HELPER_NAME " exited.");
+        ofono_watch_start(u);
+        return;
+    } else if (WIFEXITED(status))
+        pa_log_warn(HELPER_NAME " exited with status %d.", WEXITSTATUS(status));
+    else if (WIFSIGNALED(status))
+        pa_log_warn(HELPER_NAME " was killed by signal %d.", WTERMSIG(status));
+
+    /* Backoff starts over for a helper that ran for a good while. */
+    if (pa_rtclock_now() - u->start_time >= HELPER_RESTART_MAX)
+        u->restart_delay = HELPER_RESTART_MIN;
+
+    helper_restart(u);
+}
+
+static void reap_cb(pa_mainloop_api *a, pa_time_event *e, const struct timeval *t, void *userdata) {
+    struct userdata *u = userdata;
+
+    pa_assert(u);
+
+    helper_reap(u);
+}
+
+/* Helper closed its output, it has exited or is just about to. */
+static void helper_gone(struct userdata *u) {
+    pa_assert(u);
+
+    /* Last words without a newline. */
+    if (u->output)
+        helper_line(u, u->output);
+
+    pa_log_debug("helper disappeared");
+    flight_dump_log(u, "helper disappeared");
+
+    time_event_free(u, &u->watchdog_event);
+    io_free(u);
+    pa_xfree(u->heartbeat);
+    u->heartbeat = NULL;
+
+    u->reap_tries = 0;
+    if (u->pid != (pid_t) -1)
+        helper_reap(u);
+    else
+        helper_restart(u);
+}
+
+static void io_event_cb(pa_mainloop_api*a, pa_io_event* e, int fd, pa_io_event_flags_t events, void *userdata) {
+    struct userdata *u = userdata;
+    char buffer[BUFFER_MAX];
+    ssize_t r;
+
+    pa_assert(u);
+
+    if (events & PA_IO_EVENT_INPUT) {
+        if ((r = pa_read(u->fd, buffer, BUFFER_MAX - 1, NULL)) > 0) {
+            buffer[r] = '\0';
+            helper_output(u, buffer);
+        } else if (r == 0)
+            helper_gone(u);
+        else {
+            pa_log("failed read");
+            helper_gone(u);
+        }
+    } else if (events & PA_IO_EVENT_HANGUP) {
+        helper_gone(u);
+    } else if (events & PA_IO_EVENT_ERROR) {
+        pa_log("io error");
+        helper_gone(u);
+    }
+}
+
+static void helper_start(struct userdata *u) {
+    pa_assert(u);
+    pa_assert(u->pid == (pid_t) -1);
+
+    if ((u->fd = pa_start_child_for_read(HELPER_BINARY, u->dbus_address, &u->pid)) < 0) {
+        pa_log("Failed to spawn " HELPER_NAME);
+        u->pid = (pid_t) -1;
+        helper_restart(u);
+        return;
+    }
+
+    u->start_time = pa_rtclock_now();
+    pa_log_info("Helper running with pid %d", u->pid);
+
+    u->io_event = u->core->mainloop->io_new(u->core->mainloop,
+                                            u->fd,
+                                            PA_IO_EVENT_INPUT | PA_IO_EVENT_ERROR | PA_IO_EVENT_HANGUP,
+                                            io_event_cb,
+                                            u);
+}
+
+static void helper_stop(struct userdata *u, int sig) {
+    pa_assert(u);
+
+    time_event_free(u, &u->watchdog_event);
+    time_event_free(u, &u->reap_event);
+    time_event_free(u, &u->restart_event);
+
+    if (u->pid != (pid_t) -1) {
+        kill(u->pid, sig);
+
+        for (;;) {
+            if (waitpid(u->pid, NULL, 0) >= 0)
+                break;
+
+            if (errno != EINTR) {
+                pa_log("waitpid() failed: %s", pa_cstrerror(errno));
+                break;
+            }
+        }
+
+        u->pid = (pid_t) -1;
+    }
+
+    io_free(u);
+
+    pa_xfree(u->heartbeat);
+    u->heartbeat = NULL;
+}
+
+int pa__init(pa_module *m) {
+    pa_modargs *ma = NULL;
+    bool helper = true;
+    bool lazy_attach = false;
+    uint32_t pending_timeout = DEFAULT_PENDING_TIMEOUT_MS;
+    uint32_t flight_size = DEFAULT_FLIGHT_SIZE;
+    uint32_t flight_deadline = DEFAULT_FLIGHT_DEADLINE_MS;
+    uint32_t trace_size = DEFAULT_TRACE_SIZE;
+    uint32_t helper_watchdog = DEFAULT_HELPER_WATCHDOG_MS;
+    uint32_t priority_aging = DEFAULT_PRIORITY_AGING_MS;
+    uint32_t client_rate = DEFAULT_CLIENT_RATE;
+    uint32_t client_burst = DEFAULT_CLIENT_BURST;
+    uint32_t max_queued = DEFAULT_MAX_QUEUED;
+    const char *priority;
+    const char *defer_keys;
+    uint32_t query_max_age = DEFAULT_QUERY_MAX_AGE_MS;
+
+    pa_assert(m);
+
+    if (!(ma = pa_modargs_new(m->argument, valid_modargs))) {
+        pa_log("Failed to parse module arguments.");
+        goto fail;
+    }
+
+    log_init(&_log_level);
+
+    struct userdata *u = pa_xnew0(struct userdata, 1);
+    u->core = m->core;
+    m->userdata = u;
+    u->pid = (pid_t) -1;
+    u->fd = -1;
+    u->restart_delay = HELPER_RESTART_MIN;
+    u->client_slot = -1;
+    u->io_event = NULL;
+    PA_LLIST_HEAD_INIT(struct pending_request, u->pending);
+
+    if (pa_modargs_get_value_boolean(ma, "helper", &helper) < 0) {
+        pa_log("helper is boolean argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_boolean(ma, "lazy_attach", &lazy_attach) < 0) {
+        pa_log("lazy_attach is boolean argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "pending_timeout", &pending_timeout) < 0) {
+        pa_log("pending_timeout is unsigned integer argument");
+        goto fail;
+    }
+    u->pending_timeout = pending_timeout * PA_USEC_PER_MSEC;
+
+    if (pa_modargs_get_value_u32(ma, "flight_size", &flight_size) < 0) {
+        pa_log("flight_size is unsigned integer argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "flight_deadline", &flight_deadline) < 0) {
+        pa_log("flight_deadline is unsigned integer argument");
+        goto fail;
+    }
+    u->flight_deadline = flight_deadline * PA_USEC_PER_MSEC;
+
+    if (flight_size > 0) {
+        u->flight_entries = pa_xnew0(struct hidl_flight_entry, hidl_flight_entries(flight_size));
+        hidl_flight_init(&u->flight, u->flight_entries, flight_size);
+    }
+
+    if (pa_modargs_get_value_u32(ma, "trace_size", &trace_size) < 0) {
+        pa_log("trace_size is unsigned integer argument");
+        goto fail;
+    }
+
+    if (trace_size > 0)
+        u->trace = hidl_trace_new(trace_size);
+
+    if (pa_modargs_get_value_u32(ma, "helper_watchdog", &helper_watchdog) < 0) {
+        pa_log("helper_watchdog is unsigned integer argument");
+        goto fail;
+    }
+
+    if (helper_watchdog > 0 && helper_watchdog <= HELPER_HEARTBEAT_INTERVAL_MS) {
+        pa_log("helper_watchdog needs to be longer than heartbeat interval of %d ms", HELPER_HEARTBEAT_INTERVAL_MS);
+        goto fail;
+    }
+    u->helper_watchdog = helper_watchdog * PA_USEC_PER_MSEC;
+
+    u->optimistic_keys = pa_xstrdup(pa_modargs_get_value(ma, "optimistic_keys", NULL));
+
+    if ((priority = pa_modargs_get_value(ma, "priority", NULL))) {
+        if (pa_modargs_get_value_u32(ma, "priority_aging", &priority_aging) < 0) {
+            pa_log("priority_aging is unsigned integer argument");
+            goto fail;
+        }
+
+        if (!(u->sched = hidl_sched_new(u->core, priority, priority_aging * PA_USEC_PER_MSEC,
+                                        request_run, request_free, u)))
+            goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "client_rate", &client_rate) < 0) {
+        pa_log("client_rate is unsigned integer argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "client_burst", &client_burst) < 0) {
+        pa_log("client_burst is unsigned integer argument");
+        goto fail;
+    }
+
+    if (pa_modargs_get_value_u32(ma, "max_queued", &max_queued) < 0) {
+        pa_log("max_queued is unsigned integer argument");
+        goto fail;
+    }
+
+    if (!dbus_connection_allocate_data_slot(&u->client_slot)) {
+        pa_log("Failed to allocate D-Bus connection data slot.");
+        goto fail;
+    }
+
+    u->admission = hidl_admission_new(client_rate, client_burst, max_queued);
+
+    if (pa_modargs_get_value_u32(ma, "query_max_age", &query_max_age) < 0) {
+        pa_log("query_max_age is unsigned integer argument");
+        goto fail;
+    }
+    u->query_max_age = query_max_age * PA_USEC_PER_MSEC;
+
+    if (!(u->passthrough = hidl_passthrough_new(u->core, ma)))
+        goto fail;
+
+    if ((u->io_thread_sink = pa_xstrdup(pa_modargs_get_value(ma, "io_thread_sink", NULL)))) {
+        u->io_thread_keys = pa_xstrdup(pa_modargs_get_value(ma, "io_thread_keys", NULL));
+#ifdef HAVE_RTPOLL_ITEM_CALLBACK_USERDATA
+        u->io_sync = io_sync_new(u);
+#else
+        pa_log("io_thread_sink needs PulseAudio 12 or later.");
+        goto fail;
+#endif
+    }
+
+    api_register(u);
+
+    if ((defer_keys = pa_modargs_get_value(ma, "defer_keys", NULL))) {
+        u->defer = hidl_defer_new(defer_keys, pa_modargs_get_value(ma, "urgent_keys", NULL));
+        suspend_tracking_start(u);
+    }
+
+
+    if (!hw_module_attach(u)) {
+        if (!lazy_attach) {
+            pa_log("Couldn't get hw modules, is module-droid-card loaded?");
+            goto fail;
+        }
+
+        attach_start(u);
+    }
+
+    dbus_init(u);
+
+    u->dbus_address = pa_get_dbus_address_from_server_type(u->core->server_type);
+
+    if (helper && helper_spawn(u) < 0)
+        goto fail;
+
+    pa_modargs_free(ma);
+
+    return 0;
+
+fail:
+    if (ma)
+        pa_modargs_free(ma);
+
+    pa__done(m);
+
+    return -1;
+}
+
+void pa__done(pa_module *m) {
+    struct userdata *u;
+
+    pa_assert(m);
+
+    if ((u = m->userdata)) {
+        if (u->dbus_protocol)
+            dbus_done(u);
+
+        attach_stop(u);
+        pending_flush(u);
+        api_unregister(u);
+
+        if (u->defer) {
+            char *batch;
+
+            suspend_tracking_stop(u);
+
+            /* Don't lose held back writes. */
+            if ((batch = hidl_defer_take(u->defer))) {
+                if (u->passthrough && hidl_passthrough_attached(u->passthrough))
+                    hidl_passthrough_set(u->passthrough, NULL, batch);
+                pa_xfree(batch);
+            }
+
+            hidl_defer_free(u->defer);
+        }
+
+        if (u->sched)
+            hidl_sched_free(u->sched);
+
+        if (u->admission) {
+            hidl_admission_client *client;
+            void *state;
+
+            /* Clearing connection data frees the client. */
+            for (state = NULL; (client = hidl_admission_iterate(u->admission, &state)); state = NULL)
+                dbus_connection_set_data(client->owner, u->client_slot, NULL, NULL);
+
+            hidl_admission_free(u->admission);
+        }
+
+        if (u->client_slot != -1)
+            dbus_connection_free_data_slot(&u->client_slot);
+
+        if (u->io_sync)
+            io_sync_free(u);
+
+        if (u->passthrough)
+            hidl_passthrough_free(u->passthrough);
+
+        helper_stop(u, SIGTERM);
+
+        if (u->ofono_watch)
+            hidl_ofono_watch_free(u->ofono_watch);
 
-        io_free(u);
+        if (u->trace)
+            hidl_trace_free(u->trace);
 
+        pa_xfree(u->flight_entries);
+        pa_xfree(u->dbus_address);
+        pa_xfree(u->optimistic_keys);
+        pa_xfree(u->io_thread_sink);
+        pa_xfree(u->io_thread_keys);
         pa_xfree(u);
     }
 }